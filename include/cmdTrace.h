@@ -0,0 +1 @@
+../src/cmd/cmdTrace.h
\ No newline at end of file
@@ -0,0 +1 @@
+../src/util/myAlloc.h
\ No newline at end of file
@@ -0,0 +1 @@
+../src/util/myEvent.h
\ No newline at end of file
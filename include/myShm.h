@@ -0,0 +1 @@
+../src/util/myShm.h
\ No newline at end of file
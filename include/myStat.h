@@ -0,0 +1 @@
+../src/util/myStat.h
\ No newline at end of file
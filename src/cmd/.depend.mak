@@ -1,4 +1,33 @@
-cmdCharDef.o: cmdCharDef.cpp cmdParser.h cmdCharDef.h
+cmdCache.o: cmdCache.cpp ../../include/util.h cmdCache.h cmdParser.h \
+ cmdCharDef.h ../../include/myAlloc.h cmdSession.h
+cmdCancel.o: cmdCancel.cpp cmdParser.h cmdCharDef.h \
+ ../../include/myAlloc.h
+cmdCharDef.o: cmdCharDef.cpp ../../include/myStat.h \
+ ../../include/myEvent.h cmdParser.h cmdCharDef.h ../../include/myAlloc.h
 cmdCommon.o: cmdCommon.cpp ../../include/util.h cmdCommon.h cmdParser.h \
- cmdCharDef.h
-cmdParser.o: cmdParser.cpp ../../include/util.h cmdParser.h cmdCharDef.h
+ cmdCharDef.h ../../include/myAlloc.h cmdCache.h cmdTrace.h cmdRecord.h \
+ cmdTask.h
+cmdDofile.o: cmdDofile.cpp ../../include/util.h ../../include/myStat.h \
+ cmdDofile.h cmdParser.h cmdCharDef.h ../../include/myAlloc.h
+cmdParallel.o: cmdParallel.cpp ../../include/util.h cmdParallel.h \
+ cmdParser.h cmdCharDef.h ../../include/myAlloc.h cmdScript.h cmdDofile.h \
+ cmdRecord.h cmdTrace.h
+cmdParser.o: cmdParser.cpp ../../include/util.h ../../include/myStat.h \
+ cmdParser.h cmdCharDef.h ../../include/myAlloc.h cmdPkg.h cmdCache.h \
+ cmdScript.h cmdTrace.h cmdDofile.h
+cmdPkg.o: cmdPkg.cpp ../../include/util.h cmdPkg.h cmdParser.h \
+ cmdCharDef.h ../../include/myAlloc.h
+cmdProtocol.o: cmdProtocol.cpp ../../include/util.h ../../include/myShm.h \
+ cmdProtocol.h cmdParser.h cmdCharDef.h ../../include/myAlloc.h
+cmdReader.o: cmdReader.cpp cmdParser.h cmdCharDef.h \
+ ../../include/myAlloc.h
+cmdRecord.o: cmdRecord.cpp cmdRecord.h cmdParser.h cmdCharDef.h \
+ ../../include/myAlloc.h
+cmdScript.o: cmdScript.cpp ../../include/util.h cmdScript.h cmdParser.h \
+ cmdCharDef.h ../../include/myAlloc.h cmdTrace.h cmdRecord.h
+cmdSession.o: cmdSession.cpp cmdSession.h cmdParser.h cmdCharDef.h \
+ ../../include/myAlloc.h cmdScript.h cmdDofile.h cmdPkg.h
+cmdTask.o: cmdTask.cpp ../../include/myEvent.h cmdTask.h cmdParser.h \
+ cmdCharDef.h ../../include/myAlloc.h
+cmdTrace.o: cmdTrace.cpp ../../include/util.h cmdParser.h cmdCharDef.h \
+ ../../include/myAlloc.h cmdTrace.h
@@ -1,7 +1,10 @@
-cmd.d: ../../include/cmdParser.h ../../include/cmdCharDef.h 
+cmd.d: ../../include/cmdParser.h ../../include/cmdCharDef.h ../../include/cmdTrace.h 
 ../../include/cmdParser.h: cmdParser.h
 	@rm -f ../../include/cmdParser.h
 	@ln -fs ../src/cmd/cmdParser.h ../../include/cmdParser.h
 ../../include/cmdCharDef.h: cmdCharDef.h
 	@rm -f ../../include/cmdCharDef.h
 	@ln -fs ../src/cmd/cmdCharDef.h ../../include/cmdCharDef.h
+../../include/cmdTrace.h: cmdTrace.h
+	@rm -f ../../include/cmdTrace.h
+	@ln -fs ../src/cmd/cmdTrace.h ../../include/cmdTrace.h
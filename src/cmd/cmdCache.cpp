@@ -0,0 +1,267 @@
+/****************************************************************************
+  FileName     [ cmdCache.cpp ]
+  PackageName  [ cmd ]
+  Synopsis     [ Define member functions for class CmdCache ]
+  Author       [ Chung-Yang (Ric) Huang ]
+  Copyright    [ Copyleft(c) 2007-present LaDs(III), GIEE, NTU, Taiwan ]
+****************************************************************************/
+#include "util.h"
+#include "cmdCache.h"
+#include "cmdSession.h"
+
+using namespace std;
+
+//----------------------------------------------------------------------
+//    Global static funcitons
+//----------------------------------------------------------------------
+// Options as single-space separated tokens, so that "a  b" and " a b"
+// share the same entry
+static string
+normalizeOption(const string& option)
+{
+   string str, token;
+   size_t n = myStrGetTok(option, token);
+   while (token.size()) {
+      if (str.size()) str += ' ';
+      str += token;
+      n = myStrGetTok(option, token, n);
+   }
+   return str;
+}
+
+
+//----------------------------------------------------------------------
+//    Member Function for class CmdParser
+//----------------------------------------------------------------------
+CmdCache*
+CmdParser::getCache()
+{
+   if (_cache == 0) _cache = new CmdCache;
+   return _cache;
+}
+
+// Execute command "e" with "option"; pure commands go through the cache.
+// The allocations made meanwhile are counted in "stats" (_allocStats[e]
+// if 0, which only the main thread may use); it is cancelled if it runs
+// over its time budget.
+CmdExecStatus
+CmdParser::execCmd(CmdExec* e, const string& option, AllocStats* stats)
+{
+   _numExecs.fetch_add(1, memory_order_relaxed);
+   AllocScope scope(stats? stats: &_allocStats[e]);
+   CmdDeadline deadline(getBudget(e));
+   if (!e->isPure()) return e->exec(option);
+   return getCache()->exec(e, option);
+}
+
+
+//----------------------------------------------------------------------
+//    Member Function for class CmdCapture
+//----------------------------------------------------------------------
+CmdCapture::CmdCapture(Output& output)
+: _outBuf(output, false), _errBuf(output, true), _out(cmdOut()),
+  _err(cmdErr())
+{
+   _outTo = _out.rdbuf(&_outBuf);
+   _errTo = _err.rdbuf(&_errBuf);
+}
+
+CmdCapture::~CmdCapture()
+{
+   _out.rdbuf(_outTo);
+   _err.rdbuf(_errTo);
+}
+
+void
+CmdCapture::print(const Output& output)
+{
+   ostream& out = cmdOut();
+   ostream& err = cmdErr();
+   for (size_t i = 0, n = output.size(); i < n; ++i) {
+      if (output[i].first) {
+         out.flush();
+         err << output[i].second;
+      }
+      else out << output[i].second;
+   }
+}
+
+size_t
+CmdCapture::size(const Output& output)
+{
+   size_t bytes = 0;
+   for (size_t i = 0, n = output.size(); i < n; ++i)
+      bytes += output[i].second.size();
+   return bytes;
+}
+
+int
+CmdCapture::CaptureBuf::overflow(int ch)
+{
+   if (ch == traits_type::eof()) return traits_type::not_eof(ch);
+   char c = traits_type::to_char_type(ch);
+   xsputn(&c, 1);
+   return ch;
+}
+
+// Consecutive writes to the same stream are kept as one piece
+streamsize
+CmdCapture::CaptureBuf::xsputn(const char* s, streamsize n)
+{
+   if (_output.empty() || _output.back().first != _err)
+      _output.push_back(make_pair(_err, string()));
+   _output.back().second.append(s, n);
+   return n;
+}
+
+
+//----------------------------------------------------------------------
+//    Member Function for class CmdCache
+//----------------------------------------------------------------------
+// Replay the cached result of "e" on "option" if there is one for the
+// current epoch of "e". Otherwise execute it with cout and cerr captured,
+// print the captured output and keep it in the cache.
+//
+CmdExecStatus
+CmdCache::exec(CmdExec* e, const string& option)
+{
+   CacheEntry entry;
+   entry._cmd = e;
+   entry._option = normalizeOption(option);
+   entry._epoch = e->getEpoch();
+
+   {
+      unique_lock<mutex> lock(_mutex);
+      CacheMap::iterator mi = _map.find(CacheKey(e, entry._option));
+      if (mi != _map.end()) {
+         CacheList::iterator li = mi->second;
+         if (li->_epoch == entry._epoch) {
+            ++_hits;
+            _lru.splice(_lru.begin(), _lru, li);
+            entry._output = li->_output;
+            entry._status = li->_status;
+            lock.unlock();
+            CmdCapture::print(entry._output);
+            return entry._status;
+         }
+         _bytes -= li->bytes();
+         _lru.erase(li);
+         _map.erase(mi);
+      }
+      ++_misses;
+   }
+
+   {
+      CmdCapture capture(entry._output);
+      entry._status = e->exec(option);
+   }
+   entry._bytes = entry._option.size() + CmdCapture::size(entry._output);
+   CmdCapture::print(entry._output);
+
+   // Not kept if the state changed while it ran, e.g. by a package
+   // loaded meanwhile
+   if (entry._status != CMD_EXEC_QUIT &&
+       entry._status != CMD_EXEC_INTERRUPTED && !cmdInterrupted() &&
+       e->getEpoch() == entry._epoch) {
+      lock_guard<mutex> lock(_mutex);
+      insert(entry);
+   }
+   return entry._status;
+}
+
+void
+CmdCache::setLimits(size_t maxEntries, size_t maxBytes)
+{
+   lock_guard<mutex> lock(_mutex);
+   _maxEntries = maxEntries;
+   _maxBytes = maxBytes;
+   evict(_maxEntries, _maxBytes);
+}
+
+void
+CmdCache::getLimits(size_t& maxEntries, size_t& maxBytes) const
+{
+   lock_guard<mutex> lock(_mutex);
+   maxEntries = _maxEntries;
+   maxBytes = _maxBytes;
+}
+
+void
+CmdCache::clear()
+{
+   lock_guard<mutex> lock(_mutex);
+   _lru.clear();
+   _map.clear();
+   _bytes = 0;
+}
+
+void
+CmdCache::printStats() const
+{
+   lock_guard<mutex> lock(_mutex);
+   size_t total = _hits + _misses;
+   cmdOut() << "Entries   : " << _lru.size() << " / " << _maxEntries << endl
+            << "Bytes     : " << _bytes << " / " << _maxBytes << endl
+            << "Hits      : " << _hits << endl
+            << "Misses    : " << _misses << endl
+            << "Evictions : " << _evictions << endl
+            << "Hit rate  : "
+            << (total? (100.0 * _hits / total): 0.0) << "%" << endl;
+}
+
+// Entries larger than the byte limit are not kept; _mutex must be locked
+void
+CmdCache::insert(const CacheEntry& entry)
+{
+   if (entry.bytes() > _maxBytes || _maxEntries == 0) return;
+   evict(_maxEntries - 1, _maxBytes - entry.bytes());
+   _lru.push_front(entry);
+   _map[CacheKey(entry._cmd, entry._option)] = _lru.begin();
+   _bytes += entry.bytes();
+}
+
+// Drop the least recently used entries until there are at most
+// "maxEntries" entries and "maxBytes" bytes
+void
+CmdCache::evict(size_t maxEntries, size_t maxBytes)
+{
+   while (!_lru.empty() && (_lru.size() > maxEntries || _bytes > maxBytes)) {
+      const CacheEntry& last = _lru.back();
+      _bytes -= last.bytes();
+      _map.erase(CacheKey(last._cmd, last._option));
+      _lru.pop_back();
+      ++_evictions;
+   }
+}
+
+
+//----------------------------------------------------------------------
+//    Member Function for class CmdCacheSnapshot
+//----------------------------------------------------------------------
+#define CACHE_SNAPSHOT_VERSION  2
+
+bool
+CmdCacheSnapshot::save(string& data) const
+{
+   size_t maxEntries, maxBytes;
+   cmdMgr->getCache()->getLimits(maxEntries, maxBytes);
+   CmdSessionWriter::put(data, uint32_t(CACHE_SNAPSHOT_VERSION));
+   CmdSessionWriter::put(data, uint64_t(maxEntries));
+   CmdSessionWriter::put(data, uint64_t(maxBytes));
+   return true;
+}
+
+bool
+CmdCacheSnapshot::load(const char* data, size_t size)
+{
+   const char* end = data + size;
+   uint32_t version;
+   uint64_t maxEntries, maxBytes;
+   if (!CmdSessionReader::get(data, end, version) ||
+       version != CACHE_SNAPSHOT_VERSION ||
+       !CmdSessionReader::get(data, end, maxEntries) ||
+       !CmdSessionReader::get(data, end, maxBytes) || data != end)
+      return false;
+   cmdMgr->getCache()->setLimits(maxEntries, maxBytes);
+   return true;
+}
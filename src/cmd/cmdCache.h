@@ -0,0 +1,128 @@
+/****************************************************************************
+  FileName     [ cmdCache.h ]
+  PackageName  [ cmd ]
+  Synopsis     [ Define class CmdCache for results of pure commands ]
+  Author       [ Chung-Yang (Ric) Huang ]
+  Copyright    [ Copyleft(c) 2007-present LaDs(III), GIEE, NTU, Taiwan ]
+****************************************************************************/
+#ifndef CMD_CACHE_H
+#define CMD_CACHE_H
+
+#include <list>
+#include <mutex>
+#include <streambuf>
+#include "cmdParser.h"
+
+//----------------------------------------------------------------------
+//    Class : CmdCapture
+//----------------------------------------------------------------------
+// Captures what is printed to cmdOut() and cmdErr() while it exists, in
+// the order it is printed, and gives the streams back when destructed,
+// also if the command throws.
+//
+class CmdCapture
+{
+public:
+   typedef vector<pair<bool, string> >  Output;  // (to cerr, text)
+
+   CmdCapture(Output& output);
+   ~CmdCapture();
+
+   static void print(const Output& output);
+   static size_t size(const Output& output);
+
+private:
+   CmdCapture(const CmdCapture&);
+   CmdCapture& operator = (const CmdCapture&);
+
+   class CaptureBuf : public streambuf
+   {
+   public:
+      CaptureBuf(Output& output, bool err) : _output(output), _err(err) {}
+
+   protected:
+      int overflow(int ch);
+      streamsize xsputn(const char* s, streamsize n);
+
+   private:
+      Output&  _output;
+      bool     _err;
+   };
+
+   CaptureBuf   _outBuf;
+   CaptureBuf   _errBuf;
+   ostream&     _out;                // cmdOut() and cmdErr()
+   ostream&     _err;
+   streambuf*   _outTo;              // their replaced streambufs
+   streambuf*   _errTo;
+};
+
+//----------------------------------------------------------------------
+//    Class : CmdCache
+//----------------------------------------------------------------------
+// LRU cache of the output and CmdExecStatus of pure commands (see
+// CmdExec::setPure()), keyed by the command and its normalized options.
+// An entry is only replayed if the epoch of the command is unchanged.
+// The threads of DOPARallel share it.
+//
+class CmdCache
+{
+#define CMD_CACHE_ENTRIES   1024
+#define CMD_CACHE_BYTES     (16 << 20)
+
+   struct CacheEntry
+   {
+      CmdExec*       _cmd;
+      string         _option;
+      size_t         _epoch;
+      CmdExecStatus  _status;
+      CmdCapture::Output  _output;   // captured cout and cerr
+      size_t         _bytes;
+      size_t bytes() const { return _bytes; }
+   };
+
+   typedef pair<CmdExec*, string>                      CacheKey;
+   typedef list<CacheEntry>                            CacheList;
+   typedef map<CacheKey, CacheList::iterator>          CacheMap;
+
+public:
+   CmdCache() : _maxEntries(CMD_CACHE_ENTRIES), _maxBytes(CMD_CACHE_BYTES),
+      _bytes(0), _hits(0), _misses(0), _evictions(0) {}
+   ~CmdCache() {}
+
+   CmdExecStatus exec(CmdExec*, const string&);
+   void setLimits(size_t maxEntries, size_t maxBytes);
+   void getLimits(size_t& maxEntries, size_t& maxBytes) const;
+   void clear();
+   void printStats() const;
+
+private:
+   void insert(const CacheEntry&);
+   void evict(size_t maxEntries, size_t maxBytes);
+
+   CacheList         _lru;           // most recently used first
+   CacheMap          _map;
+   size_t            _maxEntries;
+   size_t            _maxBytes;
+   size_t            _bytes;         // total bytes of the entries
+   size_t            _hits;
+   size_t            _misses;
+   size_t            _evictions;
+   mutable mutex     _mutex;         // guards the members above
+};
+
+//----------------------------------------------------------------------
+//    Class : CmdCacheSnapshot
+//----------------------------------------------------------------------
+// Keeps the limits set by CAChe -Limit in session files, as "pkg.cmd":
+// a uint32 version (2), then <nEntries> and <nBytes> as uint64. The
+// entries are not kept; they are recomputed on demand.
+//
+class CmdCacheSnapshot : public CmdSnapshot
+{
+public:
+   bool save(string& data) const;
+   bool load(const char* data, size_t size);
+};
+
+#endif // CMD_CACHE_H
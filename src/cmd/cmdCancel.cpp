@@ -0,0 +1,156 @@
+/****************************************************************************
+  FileName     [ cmdCancel.cpp ]
+  PackageName  [ cmd ]
+  Synopsis     [ Define cooperative cancellation and command time budgets ]
+  Author       [ Chung-Yang (Ric) Huang ]
+  Copyright    [ Copyleft(c) 2007-present LaDs(III), GIEE, NTU, Taiwan ]
+****************************************************************************/
+#include <iomanip>
+#include <set>
+#include <mutex>
+#include <csignal>
+#include <sys/time.h>
+#include "cmdParser.h"
+
+using namespace std;
+
+//----------------------------------------------------------------------
+//    Global variable
+//----------------------------------------------------------------------
+atomic<int> cmdCancel(CMD_CANCEL_NONE);
+
+//----------------------------------------------------------------------
+//    Global static variables and funcitons
+//----------------------------------------------------------------------
+typedef chrono::steady_clock::time_point  TimePoint;
+
+// The deadlines of the running CmdDeadline's, on any thread; SIGALRM is
+// armed for the earliest
+static multiset<TimePoint> deadlines;
+static mutex deadlineMutex;
+
+// A second Ctrl-C before the first is noticed, e.g. in a command that
+// never polls cmdInterrupted(), kills the program as it would by default
+static void
+onSignal(int sig)
+{
+   int none = CMD_CANCEL_NONE;
+   if (cmdCancel.compare_exchange_strong(none, (sig == SIGINT)?
+                                         CMD_CANCEL_SIGINT: CMD_CANCEL_BUDGET))
+      return;
+   if (sig == SIGINT && none == CMD_CANCEL_SIGINT) {
+      signal(SIGINT, SIG_DFL);
+      raise(SIGINT);
+   }
+}
+
+// Raise SIGALRM at "t"; never if it is TimePoint::max()
+static void
+armTimer(const TimePoint& t)
+{
+   struct itimerval val = { { 0, 0 }, { 0, 0 } };
+   if (t != TimePoint::max()) {
+      long long us = chrono::duration_cast<chrono::microseconds>
+                        (t - chrono::steady_clock::now()).count();
+      if (us < 1) us = 1;
+      val.it_value.tv_sec = us / 1000000;
+      val.it_value.tv_usec = us % 1000000;
+   }
+   setitimer(ITIMER_REAL, &val, 0);
+}
+
+void
+initCmdCancel()
+{
+   struct sigaction sa;
+   sa.sa_handler = onSignal;
+   sigemptyset(&sa.sa_mask);
+   sa.sa_flags = SA_RESTART;
+   sigaction(SIGINT, &sa, 0);
+   sigaction(SIGALRM, &sa, 0);
+}
+
+
+//----------------------------------------------------------------------
+//    Member Function for class CmdDeadline
+//----------------------------------------------------------------------
+CmdDeadline::CmdDeadline(unsigned ms) : _armed(ms != 0 && !cmdInTask())
+{
+   if (!_armed) return;
+   _at = chrono::steady_clock::now() + chrono::milliseconds(ms);
+   lock_guard<mutex> lock(deadlineMutex);
+   if (deadlines.empty() || _at < *deadlines.begin()) armTimer(_at);
+   deadlines.insert(_at);
+}
+
+// Arm the earliest deadline left, e.g. the one it runs within; cancel if
+// that has passed as well
+CmdDeadline::~CmdDeadline()
+{
+   if (!_armed) return;
+   lock_guard<mutex> lock(deadlineMutex);
+   multiset<TimePoint>::iterator it = deadlines.find(_at);
+   bool first = (it == deadlines.begin());
+   deadlines.erase(it);
+   if (!first) return;
+   TimePoint next = deadlines.empty()? TimePoint::max(): *deadlines.begin();
+   if (next != TimePoint::max() && next <= chrono::steady_clock::now()) {
+      armTimer(TimePoint::max());
+      onSignal(SIGALRM);
+   }
+   else armTimer(next);
+}
+
+
+//----------------------------------------------------------------------
+//    Member Function for class CmdParser
+//----------------------------------------------------------------------
+// Limit each run of "e" to "ms" milliseconds, or every command without a
+// budget of its own if "e" is 0; 0 ms removes the limit.
+void
+CmdParser::setBudget(unsigned ms, const CmdExec* e)
+{
+   if (e == 0) _budget = ms;
+   else if (ms) _budgets[e] = ms;
+   else _budgets.erase(e);
+}
+
+unsigned
+CmdParser::getBudget(const CmdExec* e) const
+{
+   map<const CmdExec*, unsigned>::const_iterator it = _budgets.find(e);
+   return (it == _budgets.end())? _budget: it->second;
+}
+
+void
+CmdParser::printBudgets() const
+{
+   ostream& out = cmdOut();
+   out << setw(16) << left << "(each command)";
+   if (_budget) out << _budget << " ms" << endl;
+   else out << "no limit" << endl;
+   map<const CmdExec*, unsigned>::const_iterator it;
+   for (it = _budgets.begin(); it != _budgets.end(); ++it)
+      out << setw(16) << left << getCmdName(it->first) << it->second
+          << " ms" << endl;
+}
+
+// A command has been cancelled: report why, unless it has been reported,
+// stop all the dofiles and clear cmdCancel
+CmdExecStatus
+CmdParser::interrupted()
+{
+   int reason = cmdCancel.exchange(CMD_CANCEL_NONE);
+   if (reason != CMD_CANCEL_NONE) _lastCancel = reason;
+   if (reason != CMD_CANCEL_NONE)
+      cerr << "Error: " << (reason == CMD_CANCEL_BUDGET?
+                            "time budget exceeded": "interrupted") << "!!";
+   if (_dofile != 0) {
+      size_t n = 0;
+      for (; _dofile != 0; ++n) closeDofile();
+      if (reason != CMD_CANCEL_NONE)
+         cerr << " (" << n << " dofile" << (n > 1? "s": "") << " stopped)";
+   }
+   if (reason != CMD_CANCEL_NONE) cerr << endl;
+   return CMD_EXEC_INTERRUPTED;
+}
@@ -7,10 +7,20 @@
 ****************************************************************************/
 #include <iostream>
 #include <iomanip>
+#include <streambuf>
+#include <string>
+#include <vector>
+#include <array>
+#include <cstdio>
 #include <termios.h>
+#include <sys/epoll.h>
 #include <stdlib.h>
 #include <ctype.h>
+#include <unistd.h>
+#include <cerrno>
 #include <cassert>
+#include "myStat.h"
+#include "myEvent.h"
 #include "cmdParser.h"
 
 using namespace std;
@@ -38,30 +48,323 @@ static void set_keypress(void)
    tcsetattr(0,TCSANOW,&new_settings);
 }
 
+static const bool stdinTty = isatty(0);
+
+// The terminal is only switched to keypress mode for cin, for the whole
+// of a key; a dofile is read as it is.
+//
+class KeypressMode
+{
+public:
+   KeypressMode(istream& istr) : _on(&istr == &cin) {
+      if (_on) set_keypress();
+   }
+   ~KeypressMode() { if (_on) reset_keypress(); }
+
+private:
+   bool _on;
+};
+
+// cin reads the terminal through TermBuf once initTermInput() is called.
+// myEventLoop() calls onReady() whenever the terminal is readable, which
+// reads all the bytes there are; the rest of a key sequence or a paste is
+// then taken from memory, one wakeup for all of its bytes. With no byte
+// left, underflow() serves the loop until there is one on the main
+// thread, and reads the terminal itself on the others.
+//
+class TermBuf : public streambuf
+{
+public:
+   TermBuf() : _eof(false) {}
+
+   void onReady(unsigned) {
+      if (!readTerm()) myEventLoop().removeFd(0);
+   }
+
+protected:
+   streamsize showmanyc() {
+      if (!_ready.empty()) return streamsize(_ready.size());
+      return _eof? -1: 0;
+   }
+   int_type underflow() {
+      if (gptr() < egptr()) return traits_type::to_int_type(*gptr());
+      EventLoop& loop = myEventLoop();
+      if (loop.isLoopThread())
+         while (_ready.empty() && !_eof)
+            loop.waitFd(0, EPOLLIN);
+      else if (_ready.empty() && !_eof)
+         readTerm();
+      _buf.swap(_ready);
+      _ready.clear();
+      if (_buf.empty()) return traits_type::eof();
+      setg(&_buf[0], &_buf[0], &_buf[0] + _buf.size());
+      return traits_type::to_int_type(*gptr());
+   }
+
+private:
+   // Return false at the end of the terminal
+   bool readTerm() {
+      char buf[4096];
+      ssize_t n = read(0, buf, sizeof(buf));
+      if (n > 0) _ready.append(buf, n);
+      else if (n == 0 || (errno != EINTR && errno != EAGAIN)) _eof = true;
+      return !_eof;
+   }
+
+   string  _buf;     // the get area
+   string  _ready;   // read, after the get area
+   bool    _eof;
+};
+
+static TermBuf termBuf;
+
+// Whether the terminal is waited for through myEventLoop(), which serves
+// its other events meanwhile
+static bool
+waitsInLoop(istream& istr)
+{
+   return istr.rdbuf() == &termBuf && myEventLoop().isLoopThread() &&
+          termBuf.in_avail() <= 0;
+}
+
 //----------------------------------------------------------------------
 //    Global funcitons
 //----------------------------------------------------------------------
 static char mygetc(istream& istr)
 {
    char ch;
-   set_keypress();
+   // Ctrl-C while waiting returns no key; readCmd() discards the line.
+   // What is echoed so far is shown before the wait.
+   if (waitsInLoop(istr)) {
+      cout.flush();
+      while (myEventLoop().waitFd(0, EPOLLIN) < 0)
+         if (cmdCancel.load() == CMD_CANCEL_SIGINT) return 0;
+   }
    istr.unsetf(ios_base::skipws);
    istr >> ch;
    istr.setf(ios_base::skipws);
-   reset_keypress();
+   statAdd(STAT_CHARS_READ);
    #ifdef TEST_ASC
    cout << left << setw(6) << int(ch);
    #endif // TEST_ASC
    return ch;
 }
 
+// Called at startup, before any input. stdin is unbuffered so that no
+// byte of the terminal is left in stdio, where epoll cannot see it.
+//
+void initTermInput()
+{
+   if (!stdinTty) return;
+   setvbuf(stdin, 0, _IONBF, 0);
+   EventLoop& loop = myEventLoop();
+   if (!loop.isOpen() || !loop.isLoopThread()) return;
+   if (loop.addFd(0, EPOLLIN, [](unsigned e) { termBuf.onReady(e); }))
+      cin.rdbuf(&termBuf);
+}
+
 void mybeep()
 {
    cout << char(BEEP_CHAR);
 }
 
+static bool pasteModeOn = false;
+
+static void disableBracketedPaste()
+{
+   cout << "\033[?2004l" << flush;
+}
+
+// Ask the terminal to bracket pasted text with ESC[200~ ... ESC[201~ so that
+// getChar() can return it as a single PASTE_KEY. Only when both ends are a
+// terminal, and only once; it is turned off again at exit.
+//
+void enableBracketedPaste()
+{
+#ifdef TA_KB_SETTING
+   if (pasteModeOn || !isatty(0) || !isatty(1)) return;
+   pasteModeOn = true;
+   cout << "\033[?2004h";
+   atexit(disableBracketedPaste);
+#endif // TA_KB_SETTING
+}
+
 inline static ParseChar returnCh(int);
 
+#ifdef TA_KB_SETTING
+//----------------------------------------------------------------------
+//    Key sequences
+//----------------------------------------------------------------------
+// The multi-byte keys, as sent by xterm-compatible terminals in either
+// cursor key mode (ESC [ or ESC O), and by rxvt for Home/End. No sequence
+// is a prefix of another, so a key is known as soon as its last byte is.
+//
+#define KEY_SEQ_TIMEOUT_MS  50       // between the bytes of a key or paste
+#define PASTE_MAX_BYTES     (1 << 20)  // of a paste kept
+
+struct KeySeq
+{
+   const char*  _seq;
+   int          _key;
+};
+
+static constexpr KeySeq keySeqs[] = {
+   { "\033[A",     ARROW_UP_KEY },
+   { "\033[B",     ARROW_DOWN_KEY },
+   { "\033[C",     ARROW_RIGHT_KEY },
+   { "\033[D",     ARROW_LEFT_KEY },
+   { "\033OA",     ARROW_UP_KEY },
+   { "\033OB",     ARROW_DOWN_KEY },
+   { "\033OC",     ARROW_RIGHT_KEY },
+   { "\033OD",     ARROW_LEFT_KEY },
+   { "\033[1~",    HOME_KEY },
+   { "\033[2~",    INSERT_KEY },
+   { "\033[3~",    DELETE_KEY },
+   { "\033[4~",    END_KEY },
+   { "\033[5~",    PG_UP_KEY },
+   { "\033[6~",    PG_DOWN_KEY },
+   { "\033[7~",    HOME_KEY },
+   { "\033[8~",    END_KEY },
+   { "\033[H",     HOME_KEY },
+   { "\033[F",     END_KEY },
+   { "\033OH",     HOME_KEY },
+   { "\033OF",     END_KEY },
+   { "\033[1;5C",  WORD_RIGHT_KEY },
+   { "\033[1;5D",  WORD_LEFT_KEY },
+   { "\033[200~",  PASTE_KEY }
+};
+
+// keySeqs as a table with a row of next states for each state; state 0
+// is before the ESC
+class KeyTrie
+{
+public:
+   KeyTrie();
+
+   // -1 if "ch" leads to no key
+   int next(int state, char ch) const {
+      return (ch & 0x80)? -1: _next[state][int(ch)]; }
+   // UNDEFINED_KEY unless a whole key has been read
+   int key(int state) const { return _key[state]; }
+
+private:
+   int addState();
+
+   vector<array<short, 128> >  _next;
+   vector<int>                 _key;
+};
+
+KeyTrie::KeyTrie()
+{
+   addState();
+   for (size_t i = 0; i < sizeof(keySeqs) / sizeof(keySeqs[0]); ++i) {
+      int state = 0;
+      for (const char* p = keySeqs[i]._seq; *p; ++p) {
+         assert(_key[state] == UNDEFINED_KEY);
+         if (_next[state][int(*p)] < 0)
+            _next[state][int(*p)] = addState();
+         state = _next[state][int(*p)];
+      }
+      assert(_key[state] == UNDEFINED_KEY);
+      _key[state] = keySeqs[i]._key;
+   }
+}
+
+int
+KeyTrie::addState()
+{
+   _next.push_back(array<short, 128>());
+   _next.back().fill(-1);
+   _key.push_back(UNDEFINED_KEY);
+   return int(_key.size()) - 1;
+}
+
+static const KeyTrie&
+keyTrie()
+{
+   static const KeyTrie trie;
+   return trie;
+}
+
+// Return false if no byte of "istr" comes within KEY_SEQ_TIMEOUT_MS. Only
+// the terminal is waited for; other input is there, or at end of file.
+static bool
+waitByte(istream& istr)
+{
+   if (!waitsInLoop(istr)) return true;
+   cout.flush();
+   return myEventLoop().waitFd(0, EPOLLIN, KEY_SEQ_TIMEOUT_MS) != 0;
+}
+
+// Read the rest of a key after its ESC in one pass through keyTrie(). A
+// lone ESC, or a key cut short, is given up on when waitByte() times out,
+// and an unknown ESC [ sequence is read up to its final byte; return
+// UNDEFINED_KEY for them.
+//
+static int
+readKeySeq(istream& istr)
+{
+   const KeyTrie& trie = keyTrie();
+   const int escState = trie.next(0, char(ESC_KEY));
+   int state = escState;
+   bool csi = false;
+   while (waitByte(istr)) {
+      char ch = mygetc(istr);
+      if (istr.eof()) break;
+      int next = trie.next(state, ch);
+      if (next < 0) {
+         // Parameter bytes up to the final byte
+         while (csi && ch >= 0x20 && ch <= 0x3f && waitByte(istr)) {
+            ch = mygetc(istr);
+            if (istr.eof()) break;
+         }
+         break;
+      }
+      if (state == escState) csi = (ch == '[');
+      state = next;
+      if (trie.key(state) != UNDEFINED_KEY)
+         return trie.key(state);
+   }
+   return UNDEFINED_KEY;
+}
+
+// Read the pasted text up to the closing ESC[201~ into _pasteBuf, in the
+// keypress mode getChar() has switched the terminal to. It ends as well
+// when waitByte() times out, e.g. if the closing mark is lost; the bytes
+// beyond PASTE_MAX_BYTES are read and dropped.
+//
+void
+CmdParser::readPaste(istream& istr)
+{
+   static const string endMark = "\033[201~";
+   _pasteBuf.clear();
+   size_t nRead = 0;
+   bool dropped = false;
+   char ch;
+   while (waitByte(istr) && istr.get(ch)) {
+      ++nRead;
+      _pasteBuf += ch;
+      if (_pasteBuf.size() >= endMark.size() &&
+          _pasteBuf.compare(_pasteBuf.size() - endMark.size(),
+                            endMark.size(), endMark) == 0) {
+         _pasteBuf.resize(_pasteBuf.size() - endMark.size());
+         break;
+      }
+      // Beyond the limit, only what may start the closing mark is kept
+      if (_pasteBuf.size() >= PASTE_MAX_BYTES + endMark.size()) {
+         _pasteBuf.erase(PASTE_MAX_BYTES, 1);
+         dropped = true;
+      }
+   }
+   if (_pasteBuf.size() > PASTE_MAX_BYTES) {
+      _pasteBuf.resize(PASTE_MAX_BYTES);
+      dropped = true;
+   }
+   if (dropped) mybeep();
+   statAdd(STAT_CHARS_READ, nRead);
+}
+#endif // TA_KB_SETTING
+
 #ifndef TA_KB_SETTING
 // For HW 3, you don't need to customize this part!!!
 //
@@ -70,8 +373,9 @@ inline static ParseChar returnCh(int);
 // Make sure you DO NOT define TA_KB_SETTING in your Makefile
 //
 ParseChar
-CmdParser::getChar(istream& istr) const
+CmdParser::getChar(istream& istr)
 {
+   KeypressMode keypress(istr);
    char ch = mygetc(istr);
 
    if (istr.eof())
@@ -118,8 +422,9 @@ CmdParser::getChar(istream& istr) const
 // TA will use "make -DTA_KB_SETTING" to test your program
 //
 ParseChar
-CmdParser::getChar(istream& istr) const
+CmdParser::getChar(istream& istr)
 {
+   KeypressMode keypress(istr);
    char ch = mygetc(istr);
 
    if (istr.eof())
@@ -142,23 +447,11 @@ CmdParser::getChar(istream& istr) const
          return returnCh(ch);
 
       // Combo keys: multiple codes for one key press
-      // -- Usually starts with ESC key, so we check the "case ESC"
+      // -- Start with ESC key; the rest is decoded through keySeqs
       case ESC_KEY: {
-         char combo = mygetc(istr);
-         // Note: ARROW_KEY_INT == MOD_KEY_INT, so we only check MOD_KEY_INT
-         if (combo == char(MOD_KEY_INT)) {
-            char key = mygetc(istr);
-            if ((key >= char(MOD_KEY_BEGIN)) && (key <= char(MOD_KEY_END))) {
-               if (mygetc(istr) == MOD_KEY_DUMMY)
-                  return returnCh(int(key) + MOD_KEY_FLAG);
-               else return returnCh(UNDEFINED_KEY);
-            }
-            else if ((key >= char(ARROW_KEY_BEGIN)) &&
-                     (key <= char(ARROW_KEY_END)))
-               return returnCh(int(key) + ARROW_KEY_FLAG);
-            else return returnCh(UNDEFINED_KEY);
-         }
-         else { mybeep(); return getChar(istr); }
+         int key = readKeySeq(istr);
+         if (key == PASTE_KEY) readPaste(istr);
+         return returnCh(key);
       }
       // For the remaining printable and undefined keys
       default:
@@ -205,6 +498,10 @@ returnCh(int ch)
 //      case MOD_KEY_BEGIN  : return ParseChar(TA_MOD_KEY_BEGIN);
 //      case MOD_KEY_END    : return ParseChar(TA_MOD_KEY_END);
       case MOD_KEY_DUMMY  : return ParseChar(TA_MOD_KEY_DUMMY);
+      case PASTE_KEY      : return ParseChar(TA_PASTE_KEY);
+      case CTRL_KEY_FLAG  : return ParseChar(TA_CTRL_KEY_FLAG);
+      case WORD_RIGHT_KEY : return ParseChar(TA_WORD_RIGHT_KEY);
+      case WORD_LEFT_KEY  : return ParseChar(TA_WORD_LEFT_KEY);
       case UNDEFINED_KEY  : return ParseChar(TA_UNDEFINED_KEY);
       case BEEP_CHAR      : return ParseChar(TA_BEEP_CHAR);
       case BACK_SPACE_CHAR: return ParseChar(TA_BACK_SPACE_CHAR);
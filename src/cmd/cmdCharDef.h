@@ -38,6 +38,10 @@
 #define TA_MOD_KEY_BEGIN    TA_HOME_KEY
 #define TA_MOD_KEY_END      TA_PG_DOWN_KEY
 #define TA_MOD_KEY_DUMMY    126
+#define TA_PASTE_KEY        (1 << 10)
+#define TA_CTRL_KEY_FLAG    (1 << 11)
+#define TA_WORD_RIGHT_KEY   (67 + TA_CTRL_KEY_FLAG)
+#define TA_WORD_LEFT_KEY    (68 + TA_CTRL_KEY_FLAG)
 #define TA_UNDEFINED_KEY    INT_MAX
 #define TA_BEEP_CHAR        7
 #define TA_BACK_SPACE_CHAR  8
@@ -105,6 +109,18 @@ enum ParseChar
    MOD_KEY_END      = PG_DOWN_KEY,
    MOD_KEY_DUMMY    = 126,
 
+   //
+   // -- Bracketed paste: 27 -> 91 -> 50 -> 48 -> 48 -> 126 ... 27 -> 91 ->
+   //    50 -> 48 -> 49 -> 126; the text in between is in CmdParser::_pasteBuf
+   PASTE_KEY        = 1 << 10,
+
+   //
+   // -- Ctrl-arrow keys: 27 -> 91 -> 49 -> 59 -> 53 -> {RIGHT=67, LEFT=68};
+   //    they move the cursor by words
+   CTRL_KEY_FLAG    = 1 << 11,
+   WORD_RIGHT_KEY   = 67 + CTRL_KEY_FLAG,
+   WORD_LEFT_KEY    = 68 + CTRL_KEY_FLAG,
+
    //
    // [For undefined keys]
    UNDEFINED_KEY  = INT_MAX,
@@ -177,6 +193,18 @@ enum ParseChar
    MOD_KEY_END      = TA_MOD_KEY_END,
    MOD_KEY_DUMMY    = TA_MOD_KEY_DUMMY,
 
+   //
+   // -- Bracketed paste: 27 -> 91 -> 50 -> 48 -> 48 -> 126 ... 27 -> 91 ->
+   //    50 -> 48 -> 49 -> 126; the text in between is in CmdParser::_pasteBuf
+   PASTE_KEY        = TA_PASTE_KEY,
+
+   //
+   // -- Ctrl-arrow keys: 27 -> 91 -> 49 -> 59 -> 53 -> {RIGHT=67, LEFT=68};
+   //    they move the cursor by words
+   CTRL_KEY_FLAG    = TA_CTRL_KEY_FLAG,
+   WORD_RIGHT_KEY   = TA_WORD_RIGHT_KEY,
+   WORD_LEFT_KEY    = TA_WORD_LEFT_KEY,
+
    //
    // [For undefined keys]
    UNDEFINED_KEY    = TA_UNDEFINED_KEY,
@@ -7,8 +7,17 @@
 ****************************************************************************/
 #include <iomanip>
 #include <string>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+#include <set>
+#include <thread>
 #include "util.h"
 #include "cmdCommon.h"
+#include "cmdCache.h"
+#include "cmdTrace.h"
+#include "cmdRecord.h"
+#include "cmdTask.h"
 
 using namespace std;
 
@@ -18,11 +27,31 @@ initCommonCmd()
    if (!(cmdMgr->regCmd("Quit", 1, new QuitCmd) &&
          cmdMgr->regCmd("HIStory", 3, new HistoryCmd) &&
          cmdMgr->regCmd("HELp", 3, new HelpCmd) &&
-         cmdMgr->regCmd("DOfile", 2, new DofileCmd)
+         cmdMgr->regCmd("DOfile", 2, new DofileCmd) &&
+         cmdMgr->regCmd("PACKage", 4, new PackageCmd) &&
+         cmdMgr->regCmd("CAChe", 3, new CacheCmd) &&
+         cmdMgr->regCmd("TIMEit", 4, new TimeitCmd) &&
+         cmdMgr->regCmd("TRAce", 3, new TraceCmd) &&
+         cmdMgr->regCmd("STATs", 4, new StatsCmd) &&
+         cmdMgr->regCmd("ALLoc", 3, new AllocCmd) &&
+         cmdMgr->regCmd("RECord", 3, new RecordCmd) &&
+         cmdMgr->regCmd("REPlay", 3, new ReplayCmd) &&
+         cmdMgr->regCmd("BUDget", 3, new BudgetCmd) &&
+         cmdMgr->regCmd("DOInterleave", 3, new InterleaveCmd) &&
+         cmdMgr->regCmd("DOPARallel", 5, new ParallelCmd) &&
+         cmdMgr->regCmd("SAVEsession", 4, new SaveSessionCmd) &&
+         cmdMgr->regCmd("LOADsession", 4, new LoadSessionCmd)
       )) {
       cerr << "Registering \"init\" commands fails... exiting" << endl;
       return false;
    }
+   // HELp prints only what the registered commands tell
+   cmdMgr->getCmd("HELp")->setPure(cmdMgr->getCmdEpoch());
+   static CmdCacheSnapshot cacheSnapshot;
+   if (!cmdMgr->regSnapshot("cmd", &cacheSnapshot)) {
+      cerr << "Registering the cache snapshot fails... exiting" << endl;
+      return false;
+   }
    return true;
 }
 
@@ -40,7 +69,7 @@ HelpCmd::exec(const string& option)
    if (token.size()) {
       CmdExec* e = cmdMgr->getCmd(token);
       if (!e) return CmdExec::errorOption(CMD_OPT_ILLEGAL, token);
-      e->usage(cout);
+      e->usage(cmdOut());
    }
    else
       cmdMgr->printHelps();
@@ -60,6 +89,17 @@ HelpCmd::help() const
         << "print this help message" << endl;
 }
 
+// The list of all commands is printed by their help(), to cout
+bool
+HelpCmd::getAccess(const string& option, CmdAccess& acc) const
+{
+   string token, extra;
+   myStrGetTok(option, extra, myStrGetTok(option, token));
+   if (token.empty() || extra.size()) return false;  // exec() reports it
+   acc._reads.push_back("cmds");
+   return true;
+}
+
 //----------------------------------------------------------------------
 //    Quit [-Force]
 //----------------------------------------------------------------------
@@ -182,3 +222,727 @@ DofileCmd::help() const
    cout << setw(15) << left << "DOfile: "
         << "execute the commands in the dofile" << endl;
 }
+
+
+//----------------------------------------------------------------------
+//    PACKage [-Preload [(string pkg)...]]
+//----------------------------------------------------------------------
+// Without options, list the command packages and whether they are loaded.
+// "-Preload" loads the given packages, or all of them if none is given.
+//
+CmdExecStatus
+PackageCmd::exec(const string& option)
+{
+   // check option
+   vector<string> options;
+   if (!CmdExec::lexOptions(option, options))
+      return CMD_EXEC_ERROR;
+   if (options.empty()) {
+      cmdMgr->printPkgs();
+      return CMD_EXEC_DONE;
+   }
+   if (myStrNCmp("-Preload", options[0], 2) != 0)
+      return CmdExec::errorOption(CMD_OPT_ILLEGAL, options[0]);
+
+   bool ok = true;
+   if (options.size() == 1)
+      ok = cmdMgr->loadPkgs();
+   for (size_t i = 1, n = options.size(); i < n; ++i)
+      if (!cmdMgr->loadPkg(options[i])) ok = false;
+   return ok? CMD_EXEC_DONE: CMD_EXEC_ERROR;
+}
+
+void
+PackageCmd::usage(ostream& os) const
+{
+   os << "Usage: PACKage [-Preload [(string pkg)...]]" << endl;
+}
+
+void
+PackageCmd::help() const
+{
+   cout << setw(15) << left << "PACKage: "
+        << "list or preload command packages" << endl;
+}
+
+// Listing only reads the packages; loading one changes the registry
+bool
+PackageCmd::getAccess(const string& option, CmdAccess& acc) const
+{
+   string token;
+   myStrGetTok(option, token);
+   if (token.size()) return false;
+   acc._reads.push_back("pkgs");
+   return true;
+}
+
+
+//----------------------------------------------------------------------
+//    CAChe [-Clear | -Limit <(int nEntries)> <(int nBytes)>]
+//----------------------------------------------------------------------
+// Without options, print the statistics of the result cache of pure
+// commands (see CmdExec::setPure()).
+//
+CmdExecStatus
+CacheCmd::exec(const string& option)
+{
+   // check option
+   vector<string> options;
+   if (!CmdExec::lexOptions(option, options))
+      return CMD_EXEC_ERROR;
+   CmdCache* cache = cmdMgr->getCache();
+   if (options.empty()) {
+      cache->printStats();
+      return CMD_EXEC_DONE;
+   }
+   if (myStrNCmp("-Clear", options[0], 2) == 0) {
+      if (options.size() > 1)
+         return CmdExec::errorOption(CMD_OPT_EXTRA, options[1]);
+      cache->clear();
+      return CMD_EXEC_DONE;
+   }
+   if (myStrNCmp("-Limit", options[0], 2) != 0)
+      return CmdExec::errorOption(CMD_OPT_ILLEGAL, options[0]);
+   if (options.size() < 3)
+      return CmdExec::errorOption(CMD_OPT_MISSING, options.back());
+   if (options.size() > 3)
+      return CmdExec::errorOption(CMD_OPT_EXTRA, options[3]);
+   int nEntries, nBytes;
+   if (!myStr2Int(options[1], nEntries) || nEntries < 0)
+      return CmdExec::errorOption(CMD_OPT_ILLEGAL, options[1]);
+   if (!myStr2Int(options[2], nBytes) || nBytes < 0)
+      return CmdExec::errorOption(CMD_OPT_ILLEGAL, options[2]);
+   cache->setLimits(nEntries, nBytes);
+   return CMD_EXEC_DONE;
+}
+
+void
+CacheCmd::usage(ostream& os) const
+{
+   os << "Usage: CAChe [-Clear | -Limit <(int nEntries)> <(int nBytes)>]"
+      << endl;
+}
+
+void
+CacheCmd::help() const
+{
+   cout << setw(15) << left << "CAChe: "
+        << "report or limit the result cache of pure commands" << endl;
+}
+
+// The cache locks itself, so that the pure commands run meanwhile need
+// not tell that they use it
+bool
+CacheCmd::getAccess(const string& option, CmdAccess& acc) const
+{
+   string token;
+   myStrGetTok(option, token);
+   if (token.empty()) acc._reads.push_back("cache");
+   else if (myStrNCmp("-Clear", token, 2) == 0 ||
+            myStrNCmp("-Limit", token, 2) == 0)
+      acc._writes.push_back("cache");
+   else return false;                // exec() reports it
+   return true;
+}
+
+
+//----------------------------------------------------------------------
+//    TIMEit [-N <(int count)>] [-Warmup <(int k)>] <(string cmd)> [...]
+//----------------------------------------------------------------------
+// Look up "cmd" once and call its exec() "count" times (default 10) after
+// "k" untimed runs (default 1), with cout and cerr discarded. Then report
+// the statistics of the run times. The result cache is bypassed.
+//
+class NullBuf: public streambuf
+{
+protected:
+   int overflow(int ch) { return ch; }
+   streamsize xsputn(const char*, streamsize n) { return n; }
+};
+
+CmdExecStatus
+TimeitCmd::exec(const string& option)
+{
+   // check option
+   int count = 10, warmup = 1;
+   string token;
+   size_t n = myStrGetTok(option, token);
+   while (token.size() && token[0] == '-') {
+      int* num = 0;
+      if (myStrNCmp("-N", token, 2) == 0) num = &count;
+      else if (myStrNCmp("-Warmup", token, 2) == 0) num = &warmup;
+      else return CmdExec::errorOption(CMD_OPT_ILLEGAL, token);
+      string opt = token;
+      n = myStrGetTok(option, token, n);
+      if (token.empty())
+         return CmdExec::errorOption(CMD_OPT_MISSING, opt);
+      if (!myStr2Int(token, *num) || *num < (num == &count? 1: 0))
+         return CmdExec::errorOption(CMD_OPT_ILLEGAL, token);
+      n = myStrGetTok(option, token, n);
+   }
+   if (token.empty())
+      return CmdExec::errorOption(CMD_OPT_MISSING, "");
+   CmdExec* e = cmdMgr->getCmd(token);
+   if (e == 0) {
+      cerr << "Illegal command!! (" << token << ")" << endl;
+      return CMD_EXEC_ERROR;
+   }
+   string cmdOption = (n == string::npos)? "": option.substr(n);
+
+   size_t nFails = 0;
+   vector<double> us(count);
+   {
+      NullBuf null;
+      CmdRedirect out(cout, &null), err(cerr, &null);
+      for (int i = -warmup; i < count && !cmdInterrupted(); ++i) {
+         chrono::steady_clock::time_point t = chrono::steady_clock::now();
+         CmdExecStatus status = e->exec(cmdOption);
+         if (i < 0) continue;
+         us[i] = chrono::duration<double, micro>
+                    (chrono::steady_clock::now() - t).count();
+         if (status == CMD_EXEC_ERROR) ++nFails;
+      }
+   }
+   if (cmdInterrupted()) return CMD_EXEC_INTERRUPTED;
+
+   sort(us.begin(), us.end());
+   double sum = 0, sqSum = 0;
+   for (int i = 0; i < count; ++i) sum += us[i];
+   double mean = sum / count;
+   for (int i = 0; i < count; ++i) sqSum += (us[i] - mean) * (us[i] - mean);
+   double median = (count % 2)? us[count / 2]:
+                   (us[count / 2 - 1] + us[count / 2]) / 2;
+   size_t p99 = size_t(ceil(0.99 * count)) - 1;
+
+   ios_base::fmtflags flags = cout.flags();
+   streamsize prec = cout.precision();
+   cout << "Command : " << token << cmdOption << endl
+        << "Runs    : " << count << " (" << warmup << " warmup, "
+        << nFails << " failed)" << endl
+        << fixed << setprecision(3)
+        << "Mean    : " << mean << " us" << endl
+        << "Median  : " << median << " us" << endl
+        << "P99     : " << us[p99] << " us" << endl
+        << "Min     : " << us[0] << " us" << endl
+        << "Max     : " << us[count - 1] << " us" << endl
+        << "Stddev  : " << sqrt(sqSum / count) << " us" << endl;
+   cout.flags(flags);
+   cout.precision(prec);
+   return CMD_EXEC_DONE;
+}
+
+void
+TimeitCmd::usage(ostream& os) const
+{
+   os << "Usage: TIMEit [-N <(int count)>] [-Warmup <(int k)>] "
+      << "<(string cmd)> [...]" << endl;
+}
+
+void
+TimeitCmd::help() const
+{
+   cout << setw(15) << left << "TIMEit: "
+        << "time repeated runs of a command" << endl;
+}
+
+
+//----------------------------------------------------------------------
+//    TRAce [<(string file)> | -Stop]
+//----------------------------------------------------------------------
+// Record a span for each command, and for reading, parsing and executing
+// it, to a Chrome trace JSON "file". "-Stop" writes the file; it is also
+// written at exit. Without options, report whether it is tracing.
+//
+CmdExecStatus
+TraceCmd::exec(const string& option)
+{
+   // check option
+   string token;
+   if (!CmdExec::lexSingleOption(option, token))
+      return CMD_EXEC_ERROR;
+   if (token.empty()) {
+      if (cmdTracer.isOn())
+         cout << "Tracing to \"" << cmdTracer.getFile() << "\" ("
+              << cmdTracer.numEvents() << " spans)" << endl;
+      else cout << "Not tracing" << endl;
+      return CMD_EXEC_DONE;
+   }
+   if (myStrNCmp("-Stop", token, 2) == 0) {
+      if (!cmdTracer.isOn()) {
+         cerr << "Error: not tracing!!" << endl;
+         return CMD_EXEC_ERROR;
+      }
+      return cmdTracer.stop()? CMD_EXEC_DONE: CMD_EXEC_ERROR;
+   }
+   if (!cmdTracer.start(token))
+      return CmdExec::errorOption(CMD_OPT_FOPEN_FAIL, token);
+   return CMD_EXEC_DONE;
+}
+
+void
+TraceCmd::usage(ostream& os) const
+{
+   os << "Usage: TRAce [<(string file)> | -Stop]" << endl;
+}
+
+void
+TraceCmd::help() const
+{
+   cout << setw(15) << left << "TRAce: "
+        << "record command spans to a Chrome trace file" << endl;
+}
+
+
+//----------------------------------------------------------------------
+//    STATs
+//----------------------------------------------------------------------
+// Print the runtime counters of the command reader and parser since the
+// last STATs, and reset them.
+//
+CmdExecStatus
+StatsCmd::exec(const string& option)
+{
+   // check option
+   if (!CmdExec::lexNoOption(option))
+      return CMD_EXEC_ERROR;
+   cmdMgr->printStats();
+   return CMD_EXEC_DONE;
+}
+
+void
+StatsCmd::usage(ostream& os) const
+{
+   os << "Usage: STATs" << endl;
+}
+
+void
+StatsCmd::help() const
+{
+   cout << setw(15) << left << "STATs: "
+        << "print and reset the runtime counters" << endl;
+}
+
+
+//----------------------------------------------------------------------
+//    ALLoc [-Reset]
+//----------------------------------------------------------------------
+// Print the number of executions, allocations, frees, bytes allocated
+// and peak live bytes of each command. "-Reset" clears them afterwards.
+//
+CmdExecStatus
+AllocCmd::exec(const string& option)
+{
+   // check option
+   string token;
+   if (!CmdExec::lexSingleOption(option, token))
+      return CMD_EXEC_ERROR;
+   bool reset = false;
+   if (token.size()) {
+      if (myStrNCmp("-Reset", token, 2) != 0)
+         return CmdExec::errorOption(CMD_OPT_ILLEGAL, token);
+      reset = true;
+   }
+   cmdMgr->printAllocs(reset);
+   return CMD_EXEC_DONE;
+}
+
+void
+AllocCmd::usage(ostream& os) const
+{
+   os << "Usage: ALLoc [-Reset]" << endl;
+}
+
+void
+AllocCmd::help() const
+{
+   cout << setw(15) << left << "ALLoc: "
+        << "report the memory allocations of each command" << endl;
+}
+
+
+//----------------------------------------------------------------------
+//    RECord [<(string file)> | -Stop]
+//----------------------------------------------------------------------
+// Record each executed command line, with its start time, command and
+// status, to the binary session log "file" (see cmdRecord.h). "-Stop"
+// closes the log; it is also closed at exit. Without options, report
+// whether it is recording.
+//
+CmdExecStatus
+RecordCmd::exec(const string& option)
+{
+   // check option
+   string token;
+   if (!CmdExec::lexSingleOption(option, token))
+      return CMD_EXEC_ERROR;
+   if (token.empty()) {
+      if (cmdRecorder.isOn())
+         cout << "Recording to \"" << cmdRecorder.getFile() << "\" ("
+              << cmdRecorder.numRecords() << " lines)" << endl;
+      else cout << "Not recording" << endl;
+      return CMD_EXEC_DONE;
+   }
+   if (myStrNCmp("-Stop", token, 2) == 0) {
+      if (!cmdRecorder.isOn()) {
+         cerr << "Error: not recording!!" << endl;
+         return CMD_EXEC_ERROR;
+      }
+      return cmdRecorder.stop()? CMD_EXEC_DONE: CMD_EXEC_ERROR;
+   }
+   if (!cmdRecorder.start(token))
+      return CmdExec::errorOption(CMD_OPT_FOPEN_FAIL, token);
+   return CMD_EXEC_DONE;
+}
+
+void
+RecordCmd::usage(ostream& os) const
+{
+   os << "Usage: RECord [<(string file)> | -Stop]" << endl;
+}
+
+void
+RecordCmd::help() const
+{
+   cout << setw(15) << left << "RECord: "
+        << "record the executed command lines to a session log" << endl;
+}
+
+
+//----------------------------------------------------------------------
+//    REPlay [-Paced] [-Quiet] <(string file)>
+//----------------------------------------------------------------------
+// Execute the lines of a session log as if they were entered at the
+// prompt, as fast as possible or, with "-Paced", at the pace they were
+// recorded. "-Quiet" discards their output. The DOfile, DOInterleave and
+// DOPARallel lines are skipped, as the lines read from the dofiles are in
+// the log as well, and so are Quit, RECord and REPlay. Then report the throughput and
+// the lines whose status differs from the recorded one. It stops at the
+// first line that is interrupted.
+//
+// Each line of the log must run exactly once: a replayed line that runs
+// other commands is reported, as those are replayed on their own too.
+//
+static bool
+isReplayed(const CmdRecord& rec)
+{
+   return rec._cmd != "DOfile" && rec._cmd != "DOInterleave" &&
+          rec._cmd != "DOPARallel" && rec._cmd != "Quit" &&
+          rec._cmd != "RECord" && rec._cmd != "REPlay";
+}
+
+CmdExecStatus
+ReplayCmd::exec(const string& option)
+{
+   // check option
+   vector<string> options;
+   if (!CmdExec::lexOptions(option, options))
+      return CMD_EXEC_ERROR;
+   bool paced = false, quiet = false;
+   string file;
+   for (size_t i = 0, n = options.size(); i < n; ++i) {
+      if (myStrNCmp("-Paced", options[i], 2) == 0) paced = true;
+      else if (myStrNCmp("-Quiet", options[i], 2) == 0) quiet = true;
+      else if (file.empty()) file = options[i];
+      else return CmdExec::errorOption(CMD_OPT_EXTRA, options[i]);
+   }
+   if (file.empty())
+      return CmdExec::errorOption(CMD_OPT_MISSING, "");
+
+   // Per task, as those of DOInterleave replay independently
+   static set<const CmdTask*> replaying;
+   if (replaying.count(CmdTask::current())) {
+      cerr << "Error: REPlay cannot be nested!!" << endl;
+      return CMD_EXEC_ERROR;
+   }
+   vector<CmdRecord> recs;
+   if (!CmdRecorder::load(file, recs))
+      return CMD_EXEC_ERROR;
+
+   replaying.insert(CmdTask::current());
+   size_t nRun = 0, stopped = recs.size();
+   double recBegin = 0, recEnd = 0;
+   vector<pair<size_t, CmdExecStatus> > diffs;
+   vector<size_t> nested;
+   chrono::steady_clock::time_point start = chrono::steady_clock::now();
+   {
+      NullBuf null;
+      CmdRedirect out(cout, quiet? &null: cout.rdbuf());
+      CmdRedirect err(cerr, quiet? &null: cerr.rdbuf());
+      for (size_t i = 0, n = recs.size(); i < n; ++i) {
+         const CmdRecord& rec = recs[i];
+         if (!isReplayed(rec)) continue;
+         if (nRun++ == 0) recBegin = recEnd = rec._ts;
+         recBegin = min(recBegin, rec._ts);
+         recEnd = max(recEnd, rec._ts + rec._dur);
+         if (paced && !cmdAwaitUntil(start + chrono::microseconds
+                                            (int64_t(rec._ts - recBegin)))) {
+            stopped = i;
+            break;
+         }
+         // The count is shared with the other tasks, if any
+         size_t execs = cmdMgr->getNumExecs();
+         CmdExecStatus status = cmdMgr->execCmdLine(rec._line);
+         if (!cmdInTask() && cmdMgr->getNumExecs() - execs > 1)
+            nested.push_back(i);
+         if (status == CMD_EXEC_INTERRUPTED) { stopped = i; break; }
+         if (status != rec._status) diffs.push_back(make_pair(i, status));
+      }
+   }
+   double us = chrono::duration<double, micro>
+                  (chrono::steady_clock::now() - start).count();
+   replaying.erase(CmdTask::current());
+
+   ios_base::fmtflags flags = cout.flags();
+   streamsize prec = cout.precision();
+   cout << fixed << setprecision(3)
+        << "Replayed : " << nRun << " lines (" << recs.size() - nRun
+        << " skipped) in " << us / 1000 << " ms" << endl
+        << setprecision(1)
+        << "Rate     : " << (us > 0? nRun / us * 1e6: 0) << " lines/s"
+        << " (recorded " << (recEnd > recBegin?
+                             nRun / (recEnd - recBegin) * 1e6: 0)
+        << " lines/s)" << endl
+        << "Differ   : " << diffs.size() << " lines" << endl;
+   for (size_t i = 0, n = min(diffs.size(), size_t(10)); i < n; ++i) {
+      const CmdRecord& rec = recs[diffs[i].first];
+      cout << "  #" << diffs[i].first + 1 << " \"" << rec._line
+           << "\": recorded " << cmdStatusStr[rec._status] << ", replayed "
+           << cmdStatusStr[diffs[i].second] << endl;
+   }
+   if (diffs.size() > 10)
+      cout << "  ..." << endl;
+   cout.flags(flags);
+   cout.precision(prec);
+   if (stopped < recs.size())
+      cout << "Stopped  : interrupted at #" << stopped + 1 << endl;
+   for (size_t i = 0, n = nested.size(); i < n; ++i)
+      cerr << "Error: #" << nested[i] + 1 << " \"" << recs[nested[i]]._line
+           << "\" runs lines that are replayed on their own too!!" << endl;
+   if (stopped < recs.size()) return CMD_EXEC_INTERRUPTED;
+   return nested.empty()? CMD_EXEC_DONE: CMD_EXEC_ERROR;
+}
+
+void
+ReplayCmd::usage(ostream& os) const
+{
+   os << "Usage: REPlay [-Paced] [-Quiet] <(string file)>" << endl;
+}
+
+void
+ReplayCmd::help() const
+{
+   cout << setw(15) << left << "REPlay: "
+        << "execute the command lines of a session log" << endl;
+}
+
+
+//----------------------------------------------------------------------
+//    BUDget [<(int ms)> [<(string cmd)>]]
+//----------------------------------------------------------------------
+// Limit each run of "cmd", or of every command without a budget of its
+// own, to "ms" milliseconds; 0 removes the limit. A command that runs
+// over its budget is cancelled as by Ctrl-C, stopping the dofiles.
+// Without options, print the budgets.
+//
+CmdExecStatus
+BudgetCmd::exec(const string& option)
+{
+   // check option
+   vector<string> options;
+   if (!CmdExec::lexOptions(option, options))
+      return CMD_EXEC_ERROR;
+   if (options.empty()) {
+      cmdMgr->printBudgets();
+      return CMD_EXEC_DONE;
+   }
+   if (options.size() > 2)
+      return CmdExec::errorOption(CMD_OPT_EXTRA, options[2]);
+   int ms;
+   if (!myStr2Int(options[0], ms) || ms < 0)
+      return CmdExec::errorOption(CMD_OPT_ILLEGAL, options[0]);
+   CmdExec* e = 0;
+   if (options.size() == 2) {
+      e = cmdMgr->getCmd(options[1]);
+      if (e == 0) return CmdExec::errorOption(CMD_OPT_ILLEGAL, options[1]);
+   }
+   cmdMgr->setBudget(ms, e);
+   return CMD_EXEC_DONE;
+}
+
+void
+BudgetCmd::usage(ostream& os) const
+{
+   os << "Usage: BUDget [<(int ms)> [<(string cmd)>]]" << endl;
+}
+
+void
+BudgetCmd::help() const
+{
+   cout << setw(15) << left << "BUDget: "
+        << "limit the run time of commands" << endl;
+}
+
+// Only printing them; every command reads the budgets as it starts
+bool
+BudgetCmd::getAccess(const string& option, CmdAccess& acc) const
+{
+   string token;
+   myStrGetTok(option, token);
+   if (token.size()) return false;
+   acc._reads.push_back("budgets");
+   return true;
+}
+
+
+//----------------------------------------------------------------------
+//    DOInterleave <(string file)>...
+//----------------------------------------------------------------------
+// Execute the dofiles as tasks interleaved on this thread: while a
+// command of one waits for I/O (cmdAwaitFd(), cmdAwaitUntil()), those of
+// the others run. The output of each is printed when it ends. Quit ends
+// its task only. The whole counts as one command for the time budget.
+//
+CmdExecStatus
+InterleaveCmd::exec(const string& option)
+{
+   // check option
+   vector<string> options;
+   if (!CmdExec::lexOptions(option, options))
+      return CMD_EXEC_ERROR;
+   if (options.empty())
+      return CmdExec::errorOption(CMD_OPT_MISSING, "");
+   if (cmdInTask()) {
+      cerr << "Error: DOInterleave cannot be nested!!" << endl;
+      return CMD_EXEC_ERROR;
+   }
+
+   CmdScheduler sched;
+   for (size_t i = 0, n = options.size(); i < n; ++i)
+      sched.add(options[i]);
+   return sched.run();
+}
+
+void
+InterleaveCmd::usage(ostream& os) const
+{
+   os << "Usage: DOInterleave <(string file)>..." << endl;
+}
+
+void
+InterleaveCmd::help() const
+{
+   cout << setw(15) << left << "DOInterleave: "
+        << "execute dofiles interleaved while they wait" << endl;
+}
+
+
+//----------------------------------------------------------------------
+//    DOPARallel [-Jobs <(int n)>] <(string file)>
+//----------------------------------------------------------------------
+// Execute the dofile with its consecutive lines of commands that declare
+// what they read and write (CmdExec::getAccess()) run on "n" threads
+// (default: one per core), each as soon as the lines it conflicts with
+// are done. The outputs are printed in the order of the lines.
+//
+CmdExecStatus
+ParallelCmd::exec(const string& option)
+{
+   // check option
+   vector<string> options;
+   if (!CmdExec::lexOptions(option, options))
+      return CMD_EXEC_ERROR;
+   int jobs = thread::hardware_concurrency();
+   size_t i = 0;
+   if (options.size() && myStrNCmp("-Jobs", options[0], 2) == 0) {
+      if (options.size() < 2)
+         return CmdExec::errorOption(CMD_OPT_MISSING, options[0]);
+      if (!myStr2Int(options[1], jobs) || jobs < 1)
+         return CmdExec::errorOption(CMD_OPT_ILLEGAL, options[1]);
+      i = 2;
+   }
+   if (options.size() <= i)
+      return CmdExec::errorOption(CMD_OPT_MISSING, "");
+   if (options.size() > i + 1)
+      return CmdExec::errorOption(CMD_OPT_EXTRA, options[i + 1]);
+
+   CmdExecStatus status;
+   if (!cmdMgr->execParallel(options[i], max(jobs, 1), status))
+      return CmdExec::errorOption(CMD_OPT_FOPEN_FAIL, options[i]);
+   return status;
+}
+
+void
+ParallelCmd::usage(ostream& os) const
+{
+   os << "Usage: DOPARallel [-Jobs <(int n)>] <(string file)>" << endl;
+}
+
+void
+ParallelCmd::help() const
+{
+   cout << setw(15) << left << "DOPARallel: "
+        << "execute independent commands of the dofile in parallel" << endl;
+}
+
+
+//----------------------------------------------------------------------
+//    SAVEsession <(string file)>
+//----------------------------------------------------------------------
+// Save the history, the script variables, the budgets, the loaded
+// packages, where the dofiles being executed are, and the state of the
+// packages that registered a CmdSnapshot, to "file" (see cmdSession.h).
+//
+CmdExecStatus
+SaveSessionCmd::exec(const string& option)
+{
+   // check option
+   string token;
+   if (!CmdExec::lexSingleOption(option, token, false))
+      return CMD_EXEC_ERROR;
+   return cmdMgr->saveSession(token)? CMD_EXEC_DONE: CMD_EXEC_ERROR;
+}
+
+void
+SaveSessionCmd::usage(ostream& os) const
+{
+   os << "Usage: SAVEsession <(string file)>" << endl;
+}
+
+void
+SaveSessionCmd::help() const
+{
+   cout << setw(15) << left << "SAVEsession: "
+        << "save the session to a file" << endl;
+}
+
+
+//----------------------------------------------------------------------
+//    LOADsession <(string file)>
+//----------------------------------------------------------------------
+// Restore a session saved by SAVEsession: load its packages, put its
+// history before the current one, set its variables and budgets, and
+// restore the state of the packages. From the prompt, the dofiles it was
+// executing are resumed after the lines they had read.
+//
+CmdExecStatus
+LoadSessionCmd::exec(const string& option)
+{
+   // check option
+   string token;
+   if (!CmdExec::lexSingleOption(option, token, false))
+      return CMD_EXEC_ERROR;
+   return cmdMgr->loadSession(token)? CMD_EXEC_DONE: CMD_EXEC_ERROR;
+}
+
+void
+LoadSessionCmd::usage(ostream& os) const
+{
+   os << "Usage: LOADsession <(string file)>" << endl;
+}
+
+void
+LoadSessionCmd::help() const
+{
+   cout << setw(15) << left << "LOADsession: "
+        << "restore the session saved to a file" << endl;
+}
@@ -10,10 +10,26 @@
 
 #include "cmdParser.h"
 
-CmdClass(HelpCmd);
+// The commands that tell what they access in some of their forms, so that
+// DOPARallel may run those along with other lines
+CmdAccessClass(HelpCmd);
+CmdAccessClass(PackageCmd);
+CmdAccessClass(CacheCmd);
+CmdAccessClass(BudgetCmd);
+
 CmdClass(QuitCmd);
 CmdClass(HistoryCmd);
 CmdClass(DofileCmd);
 CmdClass(UsageCmd);
+CmdClass(TimeitCmd);
+CmdClass(TraceCmd);
+CmdClass(StatsCmd);
+CmdClass(AllocCmd);
+CmdClass(RecordCmd);
+CmdClass(ReplayCmd);
+CmdClass(InterleaveCmd);
+CmdClass(ParallelCmd);
+CmdClass(SaveSessionCmd);
+CmdClass(LoadSessionCmd);
 
 #endif // CMD_COMMON_H
@@ -0,0 +1,341 @@
+/****************************************************************************
+  FileName     [ cmdDofile.cpp ]
+  PackageName  [ cmd ]
+  Synopsis     [ Define member functions for class CmdDofileCache ]
+  Author       [ Chung-Yang (Ric) Huang ]
+  Copyright    [ Copyleft(c) 2007-present LaDs(III), GIEE, NTU, Taiwan ]
+****************************************************************************/
+#include <cstdlib>
+#include <cerrno>
+#include <sstream>
+#include <algorithm>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include "util.h"
+#include "myStat.h"
+#include "cmdDofile.h"
+
+using namespace std;
+
+//----------------------------------------------------------------------
+//    Global static funcitons
+//----------------------------------------------------------------------
+// Read the text of the regular file "path" with status "st"
+static bool
+readText(const string& path, const struct stat& st, CmdDofileText& text)
+{
+   ifstream ifs(path.c_str());
+   if (!ifs.is_open()) return false;
+   ostringstream oss;
+   oss << ifs.rdbuf();
+   text._text = make_shared<const string>(oss.str());
+   text._mtime = st.st_mtim;
+   text._size = st.st_size;
+   return true;
+}
+
+// Collect the paths of the "DOfile <path>" lines of "text", except those
+// with variables
+static void
+scanIncludes(const string& text, vector<string>& includes)
+{
+   size_t b = 0, n = text.size();
+   while (b < n) {
+      size_t e = text.find('\n', b);
+      if (e == string::npos) e = n;
+      string line = text.substr(b, e - b), cmd, file;
+      size_t p = myStrGetTok(line, cmd);
+      if (cmd.size() && myStrNCmp("DOfile", cmd, 2) == 0) {
+         myStrGetTok(line, file, p);
+         if (file.size() && file.find('$') == string::npos &&
+             find(includes.begin(), includes.end(), file) == includes.end())
+            includes.push_back(file);
+      }
+      b = e + 1;
+   }
+}
+
+
+//----------------------------------------------------------------------
+//    Member Function for class CmdParser
+//----------------------------------------------------------------------
+CmdDofileCache*
+CmdParser::getDofileCache()
+{
+   if (_dofileCache == 0) _dofileCache = new CmdDofileCache;
+   return _dofileCache;
+}
+
+
+//----------------------------------------------------------------------
+//    Member Function for class CmdDofileCache
+//----------------------------------------------------------------------
+// Return a new stream of "file", or 0 if it cannot be opened
+istream*
+CmdDofileCache::open(const string& file)
+{
+   struct stat st;
+   if (stat(file.c_str(), &st) != 0) return 0;
+   if (!S_ISREG(st.st_mode) || st.st_size > DOFILE_CACHE_FILE_BYTES) {
+      // Not blocking until a FIFO has a writer; the reader waits in poll()
+      int fd = ::open(file.c_str(), O_RDONLY | O_CLOEXEC | O_NONBLOCK);
+      return (fd < 0)? 0: new CmdStreamDofile(fd);
+   }
+
+   char* real = realpath(file.c_str(), 0);
+   if (real == 0) return 0;
+   string path = real;
+   free(real);
+   _paths[file] = path;
+
+   map<string, CacheEntry>::iterator it = _entries.find(path);
+   if (it != _entries.end()) {
+      CacheEntry& entry = it->second;
+      if (entry.isFresh(st)) {
+         statAdd(STAT_DOFILE_CACHE_HITS);
+         entry._lastUse = ++_uses;
+         prefetch(entry);
+         return new CmdDofile(entry._text);
+      }
+      _bytes -= entry._text->size();
+      _entries.erase(it);
+   }
+
+   CmdDofileText text;
+   if (_prefetcher.take(file, text) && text.isFresh(st))
+      statAdd(STAT_DOFILE_PREFETCHED);
+   else if (!readText(path, st, text)) return 0;
+
+   CacheEntry& entry = _entries[path];
+   static_cast<CmdDofileText&>(entry) = text;
+   scanIncludes(*entry._text, entry._includes);
+   entry._lastUse = ++_uses;
+   _bytes += entry._text->size();
+   istream* dofile = new CmdDofile(entry._text);
+   prefetch(entry);
+   evict();
+   return dofile;
+}
+
+// Request the files "entry" includes and that are not cached
+void
+CmdDofileCache::prefetch(const CacheEntry& entry)
+{
+   for (size_t i = 0, n = entry._includes.size(); i < n; ++i) {
+      const string& file = entry._includes[i];
+      map<string, string>::const_iterator pi = _paths.find(file);
+      if (pi != _paths.end() && _entries.count(pi->second)) continue;
+      _prefetcher.request(file);
+   }
+}
+
+void
+CmdDofileCache::evict()
+{
+   while (_bytes > DOFILE_CACHE_BYTES) {
+      map<string, CacheEntry>::iterator it, lru = _entries.end();
+      for (it = _entries.begin(); it != _entries.end(); ++it)
+         if (it->second._text.use_count() == 1 &&
+             (lru == _entries.end() ||
+              it->second._lastUse < lru->second._lastUse)) lru = it;
+      if (lru == _entries.end()) return;   // all are being read
+      _bytes -= lru->second._text->size();
+      _entries.erase(lru);
+   }
+}
+
+
+//----------------------------------------------------------------------
+//    Member Function for class CmdDofilePrefetcher
+//----------------------------------------------------------------------
+CmdDofilePrefetcher::~CmdDofilePrefetcher()
+{
+   {
+      lock_guard<mutex> lock(_mutex);
+      _stop = true;
+   }
+   _work.notify_all();
+   if (_thread.joinable()) _thread.join();
+}
+
+// Queue "file" unless it is queued, being read or waiting to be taken
+void
+CmdDofilePrefetcher::request(const string& file)
+{
+   {
+      lock_guard<mutex> lock(_mutex);
+      if (_pending.count(file) || _texts.count(file)) return;
+      _pending.insert(file);
+      _queue.push_back(file);
+      if (!_thread.joinable())
+         _thread = thread(&CmdDofilePrefetcher::run, this);
+   }
+   _work.notify_one();
+}
+
+// Get the prefetched text of "file", waiting for it if it is being read.
+// Return false if it is not prefetched; a file still in the queue is
+// dropped from it, since the caller reads it anyway.
+bool
+CmdDofilePrefetcher::take(const string& file, CmdDofileText& text)
+{
+   unique_lock<mutex> lock(_mutex);
+   deque<string>::iterator qi = find(_queue.begin(), _queue.end(), file);
+   if (qi != _queue.end()) {
+      _queue.erase(qi);
+      _pending.erase(file);
+      return false;
+   }
+   _done.wait(lock, [&] { return _pending.count(file) == 0; });
+   map<string, CmdDofileText>::iterator it = _texts.find(file);
+   if (it == _texts.end()) return false;
+   text = it->second;
+   _bytes -= text._text->size();
+   _texts.erase(it);
+   return true;
+}
+
+void
+CmdDofilePrefetcher::run()
+{
+   unique_lock<mutex> lock(_mutex);
+   while (true) {
+      _work.wait(lock, [this] { return _stop || !_queue.empty(); });
+      if (_stop) return;
+      string file = _queue.front();
+      _queue.pop_front();
+
+      lock.unlock();
+      CmdDofileText text;
+      struct stat st;
+      bool ok = stat(file.c_str(), &st) == 0 && S_ISREG(st.st_mode) &&
+                st.st_size <= DOFILE_CACHE_FILE_BYTES &&
+                readText(file, st, text);
+      lock.lock();
+
+      if (ok && _bytes + text._text->size() <= DOFILE_CACHE_BYTES) {
+         _texts[file] = text;
+         _bytes += text._text->size();
+      }
+      _pending.erase(file);
+      _done.notify_all();
+   }
+}
+
+
+//----------------------------------------------------------------------
+//    Member Function for class CmdDofileReader
+//----------------------------------------------------------------------
+CmdDofileReader::CmdDofileReader(int fd)
+: _fd(fd), _readyFd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)), _eof(false),
+  _stop(false)
+{
+   _thread = thread(&CmdDofileReader::run, this);
+}
+
+// The reader waits for input in short polls, so that it stops soon even
+// if the writer of a pipe is idle
+CmdDofileReader::~CmdDofileReader()
+{
+   {
+      lock_guard<mutex> lock(_mutex);
+      _stop = true;
+   }
+   _notFull.notify_all();
+   _thread.join();
+   close(_fd);
+   if (_readyFd >= 0) close(_readyFd);
+}
+
+// Give the previous chunk back in "chunk" and get the next one.
+// Return false at the end of the input, or if cancelled while waiting
+// (e.g. for a FIFO whose writer is idle).
+bool
+CmdDofileReader::next(string& chunk)
+{
+   unique_lock<mutex> lock(_mutex);
+   if (chunk.capacity()) _free.push_back(move(chunk));
+   while (!_eof && _chunks.empty()) {
+      lock.unlock();
+      // In short waits, as SIGINT may interrupt another thread instead
+      if (!cmdAwaitFd(_readyFd, POLLIN, DOFILE_WAIT_MS) && cmdInterrupted())
+         return false;
+      uint64_t n;
+      if (read(_readyFd, &n, sizeof(n)) < 0) {}
+      lock.lock();
+   }
+   if (_chunks.empty()) return false;
+   chunk = move(_chunks.front());
+   _chunks.pop_front();
+   _notFull.notify_one();
+   return true;
+}
+
+void
+CmdDofileReader::run()
+{
+   while (true) {
+      string buf;
+      {
+         lock_guard<mutex> lock(_mutex);
+         if (_stop) return;
+         if (!_free.empty()) {
+            buf = move(_free.front());
+            _free.pop_front();
+         }
+      }
+      buf.resize(DOFILE_CHUNK_BYTES);
+
+      ssize_t n = -1;
+      while (true) {
+         struct pollfd pfd = { _fd, POLLIN, 0 };
+         int ready = poll(&pfd, 1, 100);
+         if (ready > 0) {
+            n = read(_fd, &buf[0], buf.size());
+            if (n >= 0 || (errno != EINTR && errno != EAGAIN)) break;
+         }
+         else if (ready < 0 && errno != EINTR) break;
+         lock_guard<mutex> lock(_mutex);
+         if (_stop) return;
+      }
+
+      unique_lock<mutex> lock(_mutex);
+      if (n <= 0) {
+         if (n < 0)
+            cerr << "Error: failed to read dofile (" << errno << ")!!" << endl;
+         _eof = true;
+         notifyReady();
+         return;
+      }
+      buf.resize(n);
+      _notFull.wait(lock, [this] {
+         return _stop || _chunks.size() < DOFILE_CHUNKS; });
+      if (_stop) return;
+      _chunks.push_back(move(buf));
+      notifyReady();
+   }
+}
+
+
+void
+CmdDofileReader::notifyReady()
+{
+   uint64_t one = 1;
+   if (_readyFd >= 0 && write(_readyFd, &one, sizeof(one)) < 0) {}
+}
+
+
+//----------------------------------------------------------------------
+//    Member Function for class CmdStreamDofile::ChunkBuf
+//----------------------------------------------------------------------
+int
+CmdStreamDofile::ChunkBuf::underflow()
+{
+   if (gptr() < egptr()) return traits_type::to_int_type(*gptr());
+   if (!_reader.next(_chunk)) return traits_type::eof();
+   char* b = &_chunk[0];
+   setg(b, b, b + _chunk.size());
+   return traits_type::to_int_type(*b);
+}
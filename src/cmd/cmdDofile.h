@@ -0,0 +1,199 @@
+/****************************************************************************
+  FileName     [ cmdDofile.h ]
+  PackageName  [ cmd ]
+  Synopsis     [ Define the content cache and readers of dofiles ]
+  Author       [ Chung-Yang (Ric) Huang ]
+  Copyright    [ Copyleft(c) 2007-present LaDs(III), GIEE, NTU, Taiwan ]
+****************************************************************************/
+#ifndef CMD_DOFILE_H
+#define CMD_DOFILE_H
+
+#include <memory>
+#include <set>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <sys/stat.h>
+#include "cmdParser.h"
+
+//----------------------------------------------------------------------
+//    Class : CmdDofile
+//----------------------------------------------------------------------
+// A dofile read from a cached text. Each open dofile has its own read
+// position; the text is shared and never changed.
+//
+class CmdDofile: public istream
+{
+   class TextBuf: public streambuf
+   {
+   public:
+      TextBuf(const shared_ptr<const string>& text) : _text(text) {
+         char* b = const_cast<char*>(_text->data());
+         setg(b, b, b + _text->size());
+      }
+   private:
+      shared_ptr<const string>  _text;
+   };
+
+public:
+   CmdDofile(const shared_ptr<const string>& text)
+   : istream(0), _buf(text) { rdbuf(&_buf); }
+
+private:
+   TextBuf   _buf;
+};
+
+//----------------------------------------------------------------------
+//    Class : CmdDofileReader
+//----------------------------------------------------------------------
+// Reads file descriptor "fd" in chunks on a thread of its own, up to
+// DOFILE_CHUNKS chunks ahead of next(), so that reading the next chunk
+// overlaps with executing the commands of the current one. The memory
+// stays bounded however large the file is. Works the same for regular
+// files, pipes and FIFOs; "fd" is closed by the destructor. A Ctrl-C
+// (see cmdInterrupted()) ends the input of next().
+//
+// next() waits for the reader in cmdAwaitFd() on an eventfd, so that in
+// DOInterleave the other tasks run while a dofile waits for its input.
+//
+class CmdDofileReader
+{
+#define DOFILE_CHUNK_BYTES  (1 << 20)
+#define DOFILE_CHUNKS       4
+#define DOFILE_WAIT_MS      100      // between checks for cancellation
+
+public:
+   CmdDofileReader(int fd);
+   ~CmdDofileReader();
+
+   bool next(string& chunk);
+
+private:
+   void run();
+   void notifyReady();
+
+   int                  _fd;
+   mutex                _mutex;      // guards everything below
+   condition_variable   _notFull;    // _chunks has room, or _stop
+   int                  _readyFd;    // eventfd; written when a chunk is
+                                     // added or _eof is set
+   deque<string>        _chunks;     // read and not taken
+   deque<string>        _free;       // taken and given back, for reuse
+   bool                 _eof;
+   bool                 _stop;
+   thread               _thread;
+};
+
+//----------------------------------------------------------------------
+//    Class : CmdStreamDofile
+//----------------------------------------------------------------------
+// A dofile read through a CmdDofileReader, e.g. a huge file or a pipe
+//
+class CmdStreamDofile: public istream
+{
+   class ChunkBuf: public streambuf
+   {
+   public:
+      ChunkBuf(int fd) : _reader(fd) {}
+   protected:
+      int underflow();
+   private:
+      CmdDofileReader  _reader;
+      string           _chunk;
+   };
+
+public:
+   CmdStreamDofile(int fd) : istream(0), _buf(fd) { rdbuf(&_buf); }
+
+private:
+   ChunkBuf  _buf;
+};
+
+//----------------------------------------------------------------------
+//    Class : CmdDofileText
+//----------------------------------------------------------------------
+// The text of a dofile as it was when it was read
+//
+struct CmdDofileText
+{
+   shared_ptr<const string>  _text;
+   struct timespec           _mtime;
+   off_t                     _size;
+
+   bool isFresh(const struct stat& st) const {
+      return _mtime.tv_sec == st.st_mtim.tv_sec &&
+             _mtime.tv_nsec == st.st_mtim.tv_nsec && _size == st.st_size; }
+};
+
+//----------------------------------------------------------------------
+//    Class : CmdDofilePrefetcher
+//----------------------------------------------------------------------
+// Reads the requested dofiles on a thread of its own, so that their texts
+// are ready when they are opened. The texts wait, keyed by the path as
+// requested, for take(); no more than DOFILE_CACHE_BYTES of them.
+//
+class CmdDofilePrefetcher
+{
+public:
+   CmdDofilePrefetcher() : _bytes(0), _stop(false) {}
+   ~CmdDofilePrefetcher();
+
+   void request(const string& file);
+   bool take(const string& file, CmdDofileText& text);
+
+private:
+   void run();
+
+   mutex                         _mutex;   // guards everything below
+   condition_variable            _work;    // _queue is not empty or _stop
+   condition_variable            _done;    // a file is read
+   deque<string>                 _queue;   // files to read
+   set<string>                   _pending; // queued or being read
+   map<string, CmdDofileText>    _texts;   // file -> text
+   size_t                        _bytes;   // of _texts
+   bool                          _stop;
+   thread                        _thread;  // started by the 1st request
+};
+
+//----------------------------------------------------------------------
+//    Class : CmdDofileCache
+//----------------------------------------------------------------------
+// Texts of the dofiles opened so far, keyed by canonical path. An entry
+// is used while the file has the same mtime and size. Files larger than
+// DOFILE_CACHE_FILE_BYTES, and pipes etc., are read as CmdStreamDofile's.
+// When the cache exceeds DOFILE_CACHE_BYTES, the least recently opened
+// texts not being read are dropped.
+//
+// The files of the "DOfile <path>" lines of a cached text are prefetched
+// when it is opened, unless they are in the cache already.
+//
+class CmdDofileCache
+{
+#define DOFILE_CACHE_FILE_BYTES  (16 << 20)
+#define DOFILE_CACHE_BYTES       (64 << 20)
+
+   struct CacheEntry: public CmdDofileText
+   {
+      vector<string>            _includes;  // paths of its DOfile lines
+      size_t                    _lastUse;
+   };
+
+public:
+   CmdDofileCache() : _bytes(0), _uses(0) {}
+   ~CmdDofileCache() {}
+
+   istream* open(const string& file);
+
+private:
+   void evict();
+   void prefetch(const CacheEntry& entry);
+
+   map<string, CacheEntry>  _entries;
+   map<string, string>      _paths;     // opened file -> canonical path
+   size_t                   _bytes;
+   size_t                   _uses;
+   CmdDofilePrefetcher      _prefetcher;
+};
+
+#endif // CMD_DOFILE_H
@@ -0,0 +1,393 @@
+/****************************************************************************
+  FileName     [ cmdParallel.cpp ]
+  PackageName  [ cmd ]
+  Synopsis     [ Define dependency-aware parallel execution of dofiles ]
+  Author       [ Chung-Yang (Ric) Huang ]
+  Copyright    [ Copyleft(c) 2007-present LaDs(III), GIEE, NTU, Taiwan ]
+****************************************************************************/
+#include <set>
+#include <memory>
+#include <algorithm>
+#include "util.h"
+#include "cmdParallel.h"
+#include "cmdScript.h"
+#include "cmdDofile.h"
+#include "cmdRecord.h"
+#include "cmdTrace.h"
+
+using namespace std;
+
+//----------------------------------------------------------------------
+//    Global static funcitons
+//----------------------------------------------------------------------
+// Nodes by their number in the region; those below the first of "nodes"
+// are printed and deleted, so they are done
+typedef map<string, size_t>           CmdWriterMap;
+typedef map<string, deque<size_t> >   CmdReaderMap;
+
+// Collect in "preds" the earlier nodes that conflict with node "k" of the
+// region, which accesses "acc": the last writer of each object it reads
+// or writes, and the readers since then of each object it writes. Of the
+// region, "nodes" are those from node "first" on.
+static void
+getPreds(size_t k, const CmdAccess& acc, const deque<CmdNode*>& nodes,
+         size_t first, CmdWriterMap& writers, CmdReaderMap& readers,
+         set<CmdNode*>& preds)
+{
+   set<size_t> ks;
+   for (size_t i = 0, m = acc._reads.size(); i < m; ++i) {
+      CmdWriterMap::iterator it = writers.find(acc._reads[i]);
+      if (it != writers.end()) ks.insert(it->second);
+   }
+   for (size_t i = 0, m = acc._writes.size(); i < m; ++i) {
+      const string& obj = acc._writes[i];
+      CmdWriterMap::iterator it = writers.find(obj);
+      if (it != writers.end()) ks.insert(it->second);
+      CmdReaderMap::iterator jt = readers.find(obj);
+      if (jt != readers.end()) ks.insert(jt->second.begin(), jt->second.end());
+   }
+   for (size_t i = 0, m = acc._reads.size(); i < m; ++i) {
+      deque<size_t>& rs = readers[acc._reads[i]];
+      while (rs.size() && rs.front() < first) rs.pop_front();
+      rs.push_back(k);
+   }
+   for (size_t i = 0, m = acc._writes.size(); i < m; ++i) {
+      writers[acc._writes[i]] = k;
+      readers.erase(acc._writes[i]);
+   }
+   ks.erase(k);
+   for (set<size_t>::iterator it = ks.begin(); it != ks.end(); ++it)
+      if (*it >= first) preds.insert(nodes[*it - first]);
+}
+
+// Fold "s" into "res": QUIT or INTERRUPTED stop the rest, ERROR is kept
+static void
+mergeStatus(CmdExecStatus& res, CmdExecStatus s)
+{
+   if (res == CMD_EXEC_QUIT || res == CMD_EXEC_INTERRUPTED) return;
+   if (s == CMD_EXEC_QUIT || s == CMD_EXEC_INTERRUPTED ||
+       s == CMD_EXEC_ERROR)
+      res = s;
+}
+
+
+//----------------------------------------------------------------------
+//    Global functions
+//----------------------------------------------------------------------
+ostream&
+cmdOut()
+{
+   ostream* os = CmdThreadBuf::getStream(false);
+   return os? *os: cout;
+}
+
+ostream&
+cmdErr()
+{
+   ostream* os = CmdThreadBuf::getStream(true);
+   return os? *os: cerr;
+}
+
+
+//----------------------------------------------------------------------
+//    Member Function for class CmdParser
+//----------------------------------------------------------------------
+// Execute "file" with the lines that declare what they access run on
+// "jobs" threads (see cmdParallel.h); "status" is that of the dofile as
+// a whole. Return false if it cannot be opened.
+bool
+CmdParser::execParallel(const string& file, unsigned jobs,
+                        CmdExecStatus& status)
+{
+   istream* dofile = getDofileCache()->open(file);
+   if (dofile == 0) return false;
+
+   status = CMD_EXEC_DONE;
+   getCache();                       // not to be created by the threads
+   CmdThreadBuf outBuf(cout, false), errBuf(cerr, true);
+   CmdPool pool(jobs);
+   deque<CmdNode*> nodes;            // submitted and not printed
+   size_t first = 0;                 // the number of nodes printed
+   CmdWriterMap writers;
+   CmdReaderMap readers;
+   string line;
+   size_t lineNo = 0;
+   while (status != CMD_EXEC_QUIT && status != CMD_EXEC_INTERRUPTED &&
+          getline(*dofile, line)) {
+      ++lineNo;
+      if (line.size() && line[line.size() - 1] == '\r')
+         line.resize(line.size() - 1);
+      string tok;
+      size_t end = myStrGetTok(line, tok);
+      if (tok.empty()) continue;
+
+      CmdExec* e = 0;
+      CmdAccess acc;
+      string option = (end == string::npos)? "": line.substr(end);
+      if (!CmdScript::isScriptLine(line) && line.find('$') == string::npos)
+         e = getCmd(tok);
+      if (e != 0 && e->getAccess(option, acc)) {
+         CmdNode* n = new CmdNode(line, e, option);
+         set<CmdNode*> preds;
+         getPreds(first + nodes.size(), acc, nodes, first, writers, readers,
+                  preds);
+         nodes.push_back(n);
+         pool.submit(n, preds);
+         _readBuf.assign(line);
+         addHistory();
+         _readBuf.clear();
+         mergeStatus(status, printNodes(nodes, first, DOPAR_MAX_LINES, pool));
+         continue;
+      }
+
+      // A barrier, with the rest of the block it opens
+      string text = line + '\n';
+      size_t firstLine = lineNo;
+      int depth = CmdScript::blockDepth(line);
+      while (depth > 0 && getline(*dofile, line)) {
+         ++lineNo;
+         depth += CmdScript::blockDepth(line);
+         text += line + '\n';
+      }
+      mergeStatus(status, printNodes(nodes, first, 0, pool));
+      first = 0;
+      writers.clear();
+      readers.clear();
+      if (status != CMD_EXEC_QUIT && status != CMD_EXEC_INTERRUPTED)
+         mergeStatus(status, execBarrier(text, file, firstLine));
+   }
+   mergeStatus(status, printNodes(nodes, first, 0, pool));
+   delete dofile;
+   return true;
+}
+
+// Print the outputs of the oldest "nodes" in order, as long as they are
+// done, and wait for them until no more than "keep" are left; "first"
+// counts the nodes printed. Return their status as a whole.
+CmdExecStatus
+CmdParser::printNodes(deque<CmdNode*>& nodes, size_t& first, size_t keep,
+                      CmdPool& pool)
+{
+   CmdExecStatus status = CMD_EXEC_DONE;
+   for (; nodes.size(); nodes.pop_front(), ++first) {
+      CmdNode* node = nodes.front();
+      if (nodes.size() > keep) pool.wait(node);
+      else if (!pool.isDone(node)) break;
+      // As if read from the dofile
+      cout << _prompt << node->_line << endl << node->_out.str();
+      cout.flush();
+      cerr << node->_err.str();
+      cout << endl;
+      if (node->_start != chrono::steady_clock::time_point())
+         cmdRecorder.record(node->_line, node->_cmd, node->_status,
+                            node->_start, node->_end);
+
+      AllocStats& stats = _allocStats[node->_cmd];
+      stats._scopes += node->_allocs._scopes;
+      stats._allocs += node->_allocs._allocs;
+      stats._frees += node->_allocs._frees;
+      stats._bytes += node->_allocs._bytes;
+      stats._peak = max(stats._peak, node->_allocs._peak);
+      mergeStatus(status, node->_status);
+      delete node;
+   }
+   return status;
+}
+
+// Execute the first line of "text", line "line" of dofile "name", as if
+// read from the dofile; the rest of "text" is the rest of its block
+CmdExecStatus
+CmdParser::execBarrier(const string& text, const string& name, size_t line)
+{
+   size_t e = text.find('\n');
+   const string first = text.substr(0, e);
+   cout << _prompt << first << endl;
+   _readBuf.assign(first);
+   bool newCmd = addHistory();
+   _readBuf.clear();
+   if (!newCmd) return CMD_EXEC_NOP;
+
+   size_t depth = _dofileStack.size();
+   pushDofile(new CmdDofile(make_shared<const string>(text.substr(e + 1))),
+              name, line);
+   CmdExecStatus status = execLine(_dofile);
+   cout << endl;
+   // The dofiles it opens
+   while (status != CMD_EXEC_QUIT && status != CMD_EXEC_INTERRUPTED &&
+          !cmdInterrupted() && _dofileStack.size() > depth + 1) {
+      status = execOneCmd();
+      cout << endl;
+   }
+   // Unless the block has read it to its end, or it is interrupted
+   if (_dofileStack.size() > depth) closeDofile();
+   if (cmdInterrupted()) return CMD_EXEC_INTERRUPTED;
+   return status;
+}
+
+
+//----------------------------------------------------------------------
+//    Member Function for class CmdThreadBuf
+//----------------------------------------------------------------------
+thread_local ostream* CmdThreadBuf::_threadOut = 0;
+thread_local ostream* CmdThreadBuf::_threadErr = 0;
+
+int
+CmdThreadBuf::overflow(int ch)
+{
+   if (ch == traits_type::eof()) return traits_type::not_eof(ch);
+   return target()->sputc(traits_type::to_char_type(ch));
+}
+
+streamsize
+CmdThreadBuf::xsputn(const char* s, streamsize n)
+{
+   return target()->sputn(s, n);
+}
+
+int
+CmdThreadBuf::sync()
+{
+   return target()->pubsync();
+}
+
+
+//----------------------------------------------------------------------
+//    Member Function for class CmdPool
+//----------------------------------------------------------------------
+CmdPool::CmdPool(unsigned nThreads) : _queued(0), _next(0), _stop(false)
+{
+   if (nThreads == 0) nThreads = 1;
+   for (unsigned i = 0; i < nThreads; ++i)
+      _queues.push_back(new Queue);
+   for (unsigned i = 0; i < nThreads; ++i)
+      _threads.push_back(thread(&CmdPool::work, this, i));
+}
+
+CmdPool::~CmdPool()
+{
+   {
+      lock_guard<mutex> lock(_mutex);
+      _stop = true;
+   }
+   _work.notify_all();
+   for (size_t i = 0, n = _threads.size(); i < n; ++i) {
+      _threads[i].join();
+      delete _queues[i];
+   }
+}
+
+// Make "n" depend on those of "preds" not done yet, or else queue it,
+// spreading such nodes over the threads
+void
+CmdPool::submit(CmdNode* n, const set<CmdNode*>& preds)
+{
+   {
+      lock_guard<mutex> lock(_mutex);
+      for (set<CmdNode*>::const_iterator it = preds.begin();
+           it != preds.end(); ++it)
+         if (!(*it)->_done) {
+            (*it)->_succs.push_back(n);
+            ++n->_deps;
+         }
+      if (n->_deps) return;
+   }
+   push(_next++ % _queues.size(), n);
+}
+
+bool
+CmdPool::isDone(CmdNode* n)
+{
+   lock_guard<mutex> lock(_mutex);
+   return n->_done;
+}
+
+void
+CmdPool::wait(CmdNode* n)
+{
+   unique_lock<mutex> lock(_mutex);
+   _done.wait(lock, [n] { return n->_done; });
+}
+
+void
+CmdPool::push(size_t id, CmdNode* n)
+{
+   {
+      lock_guard<mutex> lock(_queues[id]->_mutex);
+      _queues[id]->_nodes.push_back(n);
+   }
+   {
+      lock_guard<mutex> lock(_mutex);
+      ++_queued;
+   }
+   _work.notify_one();
+}
+
+void
+CmdPool::work(size_t id)
+{
+   while (true) {
+      {
+         unique_lock<mutex> lock(_mutex);
+         _work.wait(lock, [this] { return _queued > 0 || _stop; });
+         if (_queued == 0) return;
+         --_queued;                   // one of the queues has it for us
+      }
+      exec(take(id), id);
+   }
+}
+
+// Take the newest node of queue "id", or else the oldest of another
+CmdNode*
+CmdPool::take(size_t id)
+{
+   for (size_t k = 0, n = _queues.size(); ; ++k) {
+      Queue& q = *_queues[(id + k) % n];
+      lock_guard<mutex> lock(q._mutex);
+      if (q._nodes.empty()) continue;
+      CmdNode* node = 0;
+      if (k % n == 0) {
+         node = q._nodes.back();
+         q._nodes.pop_back();
+      }
+      else {
+         node = q._nodes.front();
+         q._nodes.pop_front();
+      }
+      return node;
+   }
+}
+
+// Run through CmdParser::execCmd() as any command, with streams of its
+// own, so that its formatting state is not shared with the other threads.
+// Nodes are still released when cancelled, so that all get done.
+void
+CmdPool::exec(CmdNode* n, size_t id)
+{
+   if (!cmdInterrupted()) {
+      ostream out(&n->_out), err(&n->_err);
+      CmdThreadBuf::setStreams(&out, &err);
+      CmdTraceSpan span("exec");
+      if (span.isOn()) {
+         span.setName(cmdMgr->getCmdName(n->_cmd));
+         span.addArg("options", n->_option);
+         span.addArg("thread", id);
+      }
+      bool rec = cmdRecorder.isOn();
+      if (rec) n->_start = chrono::steady_clock::now();
+      n->_status = cmdMgr->execCmd(n->_cmd, n->_option, &n->_allocs);
+      if (rec) n->_end = chrono::steady_clock::now();
+      CmdThreadBuf::setStreams(0, 0);
+   }
+   else n->_status = CMD_EXEC_INTERRUPTED;
+
+   vector<CmdNode*> ready;
+   {
+      lock_guard<mutex> lock(_mutex);
+      n->_done = true;
+      for (size_t i = 0, m = n->_succs.size(); i < m; ++i)
+         if (--n->_succs[i]->_deps == 0) ready.push_back(n->_succs[i]);
+   }
+   _done.notify_all();
+   for (size_t i = 0, m = ready.size(); i < m; ++i)
+      push(id, ready[i]);
+}
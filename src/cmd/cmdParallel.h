@@ -0,0 +1,154 @@
+/****************************************************************************
+  FileName     [ cmdParallel.h ]
+  PackageName  [ cmd ]
+  Synopsis     [ Define the dependency DAG and thread pool of DOPARallel ]
+  Author       [ Chung-Yang (Ric) Huang ]
+  Copyright    [ Copyleft(c) 2007-present LaDs(III), GIEE, NTU, Taiwan ]
+****************************************************************************/
+#ifndef CMD_PARALLEL_H
+#define CMD_PARALLEL_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <set>
+#include <sstream>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include "cmdParser.h"
+
+using namespace std;
+
+//----------------------------------------------------------------------
+//    DOPARallel
+//----------------------------------------------------------------------
+// The dofile is read in regions of consecutive lines whose commands tell
+// what they access (CmdExec::getAccess()). The other lines (script lines,
+// lines with variables, illegal or undeclared commands) are barriers, run
+// alone in order as by DOfile.
+//
+// In a region, a line depends on each earlier line that writes what it
+// reads or writes, or reads what it writes. Each line is submitted to a
+// CmdPool as soon as it is read, and runs on its threads once its
+// dependencies are done, while the rest of the dofile is read. The output
+// of each is printed, and the line recorded (see CmdRecorder), in the
+// order of the lines as soon as those before it are. No more than
+// DOPAR_MAX_LINES lines are read ahead of the one printed next.
+//
+// A line runs through CmdParser::execCmd() like any other, with its time
+// budget (running over it cancels the dofile), its allocation scope and
+// the cache of pure commands.
+//
+
+//----------------------------------------------------------------------
+//    Class : CmdNode
+//----------------------------------------------------------------------
+class CmdNode
+{
+   typedef chrono::steady_clock::time_point  TimePoint;
+
+public:
+   CmdNode(const string& line, CmdExec* e, const string& option)
+   : _line(line), _cmd(e), _option(option), _deps(0),
+     _status(CMD_EXEC_DONE), _done(false) {}
+
+   string               _line;
+   CmdExec*             _cmd;
+   string               _option;
+   vector<CmdNode*>     _succs;      // the lines that depend on it
+   size_t               _deps;       // lines it depends on not done yet
+   stringbuf            _out;        // what it printed to cout
+   stringbuf            _err;        // and to cerr
+   CmdExecStatus        _status;
+   AllocStats           _allocs;
+   TimePoint            _start;      // of its execution, if recording
+   TimePoint            _end;
+   bool                 _done;       // guarded by the mutex of CmdPool,
+                                     // as are _succs and _deps
+};
+
+//----------------------------------------------------------------------
+//    Class : CmdThreadBuf
+//----------------------------------------------------------------------
+// Installed as the streambuf of cout or cerr during DOPARallel. A thread
+// of the pool has streams of its own, returned by cmdOut() and cmdErr(),
+// into the output of its node; what it writes to cout or cerr directly
+// goes on to them. What any other thread writes goes on to the streambuf
+// it replaced.
+//
+class CmdThreadBuf: public streambuf
+{
+public:
+   CmdThreadBuf(ostream& os, bool err)
+   : _os(os), _to(os.rdbuf()), _err(err) { _os.rdbuf(this); }
+   ~CmdThreadBuf() { _os.rdbuf(_to); }
+
+   // Those of the calling thread; 0 for cout and cerr
+   static void setStreams(ostream* out, ostream* err) {
+      _threadOut = out; _threadErr = err; }
+   static ostream* getStream(bool err) { return err? _threadErr: _threadOut; }
+
+protected:
+   int overflow(int ch);
+   streamsize xsputn(const char* s, streamsize n);
+   int sync();
+
+private:
+   streambuf* target() const {
+      ostream* os = getStream(_err);
+      return os? os->rdbuf(): _to; }
+
+   static thread_local ostream*  _threadOut;
+   static thread_local ostream*  _threadErr;
+
+   ostream&     _os;
+   streambuf*   _to;
+   bool         _err;
+};
+
+//----------------------------------------------------------------------
+//    Class : CmdPool
+//----------------------------------------------------------------------
+// Worker threads, each taking the nodes ready to run from the back of
+// its own queue, or else stealing from the front of another's. A node
+// that makes others ready queues them on the thread that ran it.
+// Nodes are submitted while the earlier ones run.
+//
+class CmdPool
+{
+#define DOPAR_MAX_LINES  1024        // submitted and not printed, at most
+
+   struct Queue
+   {
+      mutex              _mutex;
+      deque<CmdNode*>    _nodes;
+   };
+
+public:
+   CmdPool(unsigned nThreads);
+   ~CmdPool();
+
+   void submit(CmdNode* n, const set<CmdNode*>& preds);
+   bool isDone(CmdNode* n);
+   void wait(CmdNode* n);
+
+private:
+   void work(size_t id);
+   CmdNode* take(size_t id);
+   void push(size_t id, CmdNode* n);
+   void exec(CmdNode* n, size_t id);
+
+   vector<Queue*>       _queues;
+   vector<thread>       _threads;
+   mutex                _mutex;      // guards the members below
+   condition_variable   _work;       // _queued > 0, or _stop
+   condition_variable   _done;       // a node is done
+   size_t               _queued;     // in the queues, not taken yet
+   size_t               _next;       // queue for the next submitted node
+   bool                 _stop;
+};
+
+#endif // CMD_PARALLEL_H
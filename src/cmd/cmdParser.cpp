@@ -9,8 +9,15 @@
 #include <iostream>
 #include <iomanip>
 #include <cstdlib>
+#include <algorithm>
 #include "util.h"
+#include "myStat.h"
 #include "cmdParser.h"
+#include "cmdPkg.h"
+#include "cmdCache.h"
+#include "cmdScript.h"
+#include "cmdTrace.h"
+#include "cmdDofile.h"
 
 using namespace std;
 
@@ -19,25 +26,65 @@ using namespace std;
 //----------------------------------------------------------------------
 void mybeep();
 
+//----------------------------------------------------------------------
+//    Global variable
+//----------------------------------------------------------------------
+const char* cmdStatusStr[CMD_EXEC_TOT] = {
+   "DONE", "ERROR", "QUIT", "NOP", "INTERRUPTED"
+};
+
 
 //----------------------------------------------------------------------
 //    Member Function for class cmdParser
 //----------------------------------------------------------------------
+CmdParser::~CmdParser()
+{
+   for (size_t i = 0, n = _pkgs.size(); i < n; ++i)
+      delete _pkgs[i];
+   delete _cache;
+   delete _script;
+   delete _dofileCache;
+}
+
 // return false if file cannot be opened
 // Please refer to the comments in "DofileCmd::exec", cmdCommon.cpp
 bool
 CmdParser::openDofile(const string& dof)
 {
-	// TODO...
-	_dofileStack.push(_dofile);
-    _dofile = new ifstream(dof.c_str());
-    if(_dofileStack.size() >= 1024) { return false; }
-    if(!_dofile->is_open())
-    {
-    	closeDofile();
-    	return false;
-    }
-    return true;
+   // TODO...
+   // The stack is left as it is on failure
+   if (_dofileStack.size() + 1 >= DOFILE_MAX_DEPTH) return false;
+   istream* dofile = getDofileCache()->open(dof);
+   if (dofile == 0) return false;
+   pushDofile(dofile, dof, 0);
+   return true;
+}
+
+// Execute the lines of "dofile", e.g. text in memory, as a dofile named
+// "name"; it is deleted when closed. Return false (and delete it) if the
+// dofiles are nested too deep.
+bool
+CmdParser::openDofile(istream* dofile, const string& name)
+{
+   if (_dofileStack.size() + 1 >= DOFILE_MAX_DEPTH) {
+      delete dofile;
+      return false;
+   }
+   pushDofile(dofile, name, 0);
+   return true;
+}
+
+// Execute "dofile", named "name", after its first "line" lines
+void
+CmdParser::pushDofile(istream* dofile, const string& name, size_t line)
+{
+   _dofileStack.push(_dofile);
+   _dofilePosStack.push(make_pair(_dofileName, _dofileLine));
+   _dofile = dofile;
+   _dofileName = name;
+   _dofileLine = line;
+   statAdd(STAT_DOFILE_OPENS);
+   statMax(STAT_DOFILE_MAX_DEPTH, _dofileStack.size());
 }
 
 // Must make sure _dofile != 0
@@ -49,18 +96,22 @@ CmdParser::closeDofile()
    delete _dofile;
    _dofile = _dofileStack.top();
    _dofileStack.pop();
+   _dofileName = _dofilePosStack.top().first;
+   _dofileLine = _dofilePosStack.top().second;
+   _dofilePosStack.pop();
 }
 
 // Return false if registration fails
 bool
 CmdParser::regCmd(const string& cmd, unsigned nCmp, CmdExec* e)
 {
+   lock_guard<mutex> lock(_cmdMapMutex);
    // Make sure cmd hasn't been registered and won't cause ambiguity
    string str = cmd;
    unsigned s = str.size();
    if (s < nCmp) return false;
    while (true) {
-      if (getCmd(str)) return false;
+      if (findCmd(str)) return false;
       if (s == nCmp) break;
       str.resize(--s);
    }
@@ -77,26 +128,75 @@ CmdParser::regCmd(const string& cmd, unsigned nCmp, CmdExec* e)
    assert(e != 0);
    e->setOptCmd(optCmd);
 
-   // insert (mandCmd, e) to _cmdMap; return false if insertion fails.
-   return (_cmdMap.insert(CmdRegPair(mandCmd, e))).second;
+   // insert (mandCmd, e) to a copy of _cmdMap and publish it; return
+   // false if insertion fails.
+   CmdMap* cmdMap = new CmdMap(*_cmdMap);
+   if (!cmdMap->insert(CmdRegPair(mandCmd, e)).second) {
+      delete cmdMap;
+      return false;
+   }
+   publishCmdMap(cmdMap);
+   return true;
+}
+
+// Replace _cmdMap with "cmdMap"; _cmdMapMutex must be locked, so the
+// writers may read _cmdMap plainly. The replaced snapshot is deleted by
+// whoever drops the last reference to it, be it here or a CmdMapRef.
+void
+CmdParser::publishCmdMap(const CmdMap* cmdMap)
+{
+   atomic_store(&_cmdMap, CmdMapPtr(cmdMap));
+   ++_cmdEpoch;
 }
 
 // Return false on "quit" or if excetion happens
 CmdExecStatus
 CmdParser::execOneCmd()
 {
-   bool newCmd = false;
+   CmdTraceSpan span("execOneCmd");
+   istream* istr = &cin;
    if (_dofile != 0)
-      newCmd = readCmd(*_dofile);
-   else
-      newCmd = readCmd(cin);
+      istr = _dofile;
+
+   bool newCmd = false;
+   {
+      CmdTraceSpan read("read");
+      newCmd = readCmd(*istr);
+   }
 
-   // execute the command
+   // execute the command; a Ctrl-C at the prompt has discarded the line
+   // it was typed in (see readCmd()), and one since then is dropped
    if (newCmd) {
-      string option;
-      CmdExec* e = parseCmd(option);
-      if (e != 0)
-         return e->exec(option);
+      if (span.isOn()) traceCmd(span);
+      if (istr == &cin) cmdCancel.store(CMD_CANCEL_NONE);
+      CmdExecStatus status = execLine(istr);
+      if (status == CMD_EXEC_INTERRUPTED || cmdInterrupted())
+         return interrupted();
+      return status;
+   }
+
+   span.cancel();
+   // A dofile whose reading was cut short (see CmdDofileReader::next())
+   if (istr != &cin && cmdInterrupted()) return interrupted();
+   return CMD_EXEC_NOP;
+}
+
+// Execute "cmdLine" as if it was entered at the prompt, without printing
+// the prompt or reading the terminal (e.g. for "-Command" in main()).
+CmdExecStatus
+CmdParser::execCmdLine(const string& cmdLine)
+{
+   _readBuf.assign(cmdLine);
+   bool newCmd = addHistory();
+   _readBuf.clear();
+
+   if (newCmd) {
+      CmdTraceSpan span("execCmdLine");
+      if (span.isOn()) traceCmd(span);
+      CmdExecStatus status = execLine(0);
+      if (status == CMD_EXEC_INTERRUPTED || cmdInterrupted())
+         return interrupted();
+      return status;
    }
 
    return CMD_EXEC_NOP;
@@ -105,10 +205,12 @@ CmdParser::execOneCmd()
 // For each CmdExec* in _cmdMap, call its "help()" to print out the help msg.
 // Print an endl at the end.
 void
-CmdParser::printHelps() const
+CmdParser::printHelps()
 {
   // TODO...
-	for(auto it=_cmdMap.begin(); it!=_cmdMap.end(); ++it)
+  initPkgs();
+  CmdMapRef cmdMap(this);
+	for(auto it=cmdMap->begin(); it!=cmdMap->end(); ++it)
   { 
 		it->second->help();
 	}
@@ -130,10 +232,64 @@ CmdParser::printHistory(int nPrint) const
       cout << "   " << i << ": " << _history[i] << endl;
 }
 
+// Print the runtime counters (see myStat.h) and reset them
+void
+CmdParser::printStats() const
+{
+   size_t bytes = 0;
+   for (size_t i = 0, n = _history.size(); i < n; ++i)
+      bytes += _history[i].size();
+   for (int i = 0; i < STAT_TOT; ++i)
+      cout << setw(18) << left << statName(StatCounter(i)) << ": "
+           << statGet(StatCounter(i)) << endl;
+   cout << setw(18) << left << "History size" << ": " << _history.size()
+        << endl
+        << setw(18) << left << "History bytes" << ": " << bytes << endl
+        << setw(18) << left << "Dofile depth" << ": " << _dofileStack.size()
+        << endl;
+   resetStats();
+}
+
+// Print the allocations made by each command, most bytes first, and
+// reset them if "reset"
+void
+CmdParser::printAllocs(bool reset)
+{
+   typedef pair<size_t, const CmdExec*> BytesCmd;
+   vector<BytesCmd> cmds;
+   map<const CmdExec*, AllocStats>::const_iterator si;
+   for (si = _allocStats.begin(); si != _allocStats.end(); ++si)
+      if (si->second._scopes)
+         cmds.push_back(BytesCmd(si->second._bytes, si->first));
+   sort(cmds.rbegin(), cmds.rend());
+
+   cout << setw(16) << left << "Command" << right << setw(8) << "Execs"
+        << setw(12) << "Allocs" << setw(12) << "Frees" << setw(14) << "Bytes"
+        << setw(14) << "Peak live" << endl;
+   for (size_t i = 0, n = cmds.size(); i < n; ++i) {
+      string name = getCmdName(cmds[i].second);
+      if (name.empty()) name = "(package stub)";
+      const AllocStats& s = _allocStats[cmds[i].second];
+      cout << setw(16) << left << name << right << setw(8) << s._scopes
+           << setw(12) << s._allocs << setw(12) << s._frees
+           << setw(14) << s._bytes << setw(14) << s._peak << endl;
+   }
+   AllocStats total = getAllocTotal();
+   cout << setw(16) << left << "(whole program)" << right << setw(8) << ""
+        << setw(12) << total._allocs << setw(12) << total._frees
+        << setw(14) << total._bytes << endl << left;
+   // Not erased; the running ALLoc command is counting into its entry
+   if (reset)
+      for (map<const CmdExec*, AllocStats>::iterator it = _allocStats.begin();
+           it != _allocStats.end(); ++it)
+         it->second = AllocStats();
+}
+
 
 //
-// Parse the command from _history.back();
-// Let string str = _history.back();
+// Parse the command from "line", i.e. _history.back() with its variables
+// replaced (see CmdParser::execLine());
+// Let string str = line;
 //
 // 1. Read the command string (may contain multiple words) from the leading
 //    part of str (i.e. the first word) and retrive the corresponding
@@ -147,17 +303,18 @@ CmdParser::printHistory(int nPrint) const
 //    words and beyond) and store them in "option"
 //
 CmdExec*
-CmdParser::parseCmd(string& option)
+CmdParser::parseCmd(const string& line, string& option)
 {
 	assert(_tempCmdStored == false);
-  assert(!_history.empty());
-  string str = _history.back();
+  string str = line;
   // TODO...done
-  assert(str[0] != 0 && str[0] != ' ');
 
   // Get the first token and the end-Idx of the token
+  // (a line can be empty once its variables are replaced)
   string temp;
   int end = myStrGetTok(str, temp);
+  if (temp.empty()) return NULL;
+  statAdd(STAT_LINES_PARSED);
 
   // Make sure the command matches
   // If matches, erase the command part of the str(entire input)
@@ -314,6 +471,8 @@ void
 CmdParser::listCmd(const string& str)
 {
    	// TODO...
+  initPkgs();
+  CmdMapRef cmdMap(this);
 	bool _exec = true;
 	int len = str.length();
   string command_1, command_2;
@@ -324,7 +483,7 @@ CmdParser::listCmd(const string& str)
 	{
     cout << endl;
 		int cnt = 1;
-		for(map<string, CmdExec*>::iterator it=_cmdMap.begin(); it!=_cmdMap.end(); ++cnt, ++it)
+		for(CmdMap::const_iterator it=cmdMap->begin(); it!=cmdMap->end(); ++cnt, ++it)
 		{
       command_1 = it->first;
       command_2 = it->second->getOptCmd();
@@ -344,9 +503,10 @@ CmdParser::listCmd(const string& str)
 
     // Get the word right before cursor
     string foreTab = "";
-    int startIdx = _readBufPtr-_readBuf;
-    for(char* i=_readBufPtr-1;i>=_readBuf;startIdx--, i--) { if(*i==' ') break; }
-    for(int i=startIdx;i<_readBufPtr-_readBuf;i++) { foreTab += _readBuf[i]; }
+    int cursor = _readBuf.cursor();
+    int startIdx = cursor;
+    for(int i=cursor-1;i>=0;startIdx--, i--) { if(_readBuf[i]==' ') break; }
+    _readBuf.append(foreTab, startIdx, cursor);
 
     // Determine match or not
     int match, match_2;
@@ -355,9 +515,9 @@ CmdParser::listCmd(const string& str)
 
     // If the cursor is not "on" the first word => use firstword for matching    
     int len = firstWord.length();
-    if(_readBufPtr-_readBuf > len)
+    if(cursor > len)
     {
-      for(map<string, CmdExec*>::iterator it=_cmdMap.begin(); it!=_cmdMap.end(); ++it)
+      for(CmdMap::const_iterator it=cmdMap->begin(); it!=cmdMap->end(); ++it)
       {
         // Store the full command in command_1
         command_1 = it->first;
@@ -469,7 +629,7 @@ CmdParser::listCmd(const string& str)
     // If the cursor is "on" the first word => use foreTab for matching
     else
     {
-      for(map<string, CmdExec*>::iterator it=_cmdMap.begin(); it!=_cmdMap.end(); ++it)
+      for(CmdMap::const_iterator it=cmdMap->begin(); it!=cmdMap->end(); ++it)
       {
         command_1 = it->first;
         command_2 = it->second->getOptCmd();
@@ -495,7 +655,7 @@ CmdParser::listCmd(const string& str)
       for(int i=0, cnt=1, s=matchCmd.size();i<s;i++, cnt++)
       {
         command_1 = matchCmd[i];
-        command_2 = _cmdMap[matchCmd[i]]->getOptCmd();
+        command_2 = cmdMap->find(matchCmd[i])->second->getOptCmd();
         command_1 += command_2;
         cout << setw(12) << left << command_1;
         if(cnt%5==0) cout << endl;
@@ -507,7 +667,7 @@ CmdParser::listCmd(const string& str)
     else if(matchCmd.size() == 1)
     {
       command_1 = matchCmd[0];
-      command_2 = _cmdMap[matchCmd[0]]->getOptCmd();
+      command_2 = cmdMap->find(matchCmd[0])->second->getOptCmd();
       command_1 += command_2;
 
       for(int i=foreTab.length(), s=command_1.length();i<s;i++)
@@ -532,16 +692,45 @@ CmdParser::listCmd(const string& str)
 // 2. The optional part can be partially omitted.
 // 3. All string comparison are "case-insensitive".
 //
+// Commands of packages that are not initialized yet are not in _cmdMap;
+// if "cmd" is not found, the pending packages are initialized and the
+// lookup is retried.
+//
 CmdExec*
 CmdParser::getCmd(string cmd)
+{
+  CmdExec* e = findCmd(cmd);
+  if (e == 0 && pkgsPending()) {
+    initPkgs();
+    e = findCmd(cmd);
+  }
+  return e;
+}
+
+// Return the name "e" is registered with; "" if it is not registered
+string
+CmdParser::getCmdName(const CmdExec* e) const
+{
+   CmdMapRef cmdMap(this);
+   for (CmdMap::const_iterator it = cmdMap->begin(); it != cmdMap->end(); ++it)
+      if (it->second == e) return it->first + e->getOptCmd();
+   return "";
+}
+
+// Look "cmd" up in _cmdMap only
+CmdExec*
+CmdParser::findCmd(const string& cmd) const
 {
   CmdExec* e = 0;
   // TODO...done
-  int match, len;
+  int match = -1, len;
+  size_t scanned = 0;
   string command_1, command_2;
 
-  for(map<string, CmdExec*>::iterator it=_cmdMap.begin(); it!=_cmdMap.end(); ++it)
+  CmdMapRef cmdMap(this);
+  for(CmdMap::const_iterator it=cmdMap->begin(); it!=cmdMap->end(); ++it)
   {
+    ++scanned;
     // Store the full command in command_1
     command_1 = it->first;
     command_2 = it->second->getOptCmd();
@@ -564,6 +753,8 @@ CmdParser::getCmd(string cmd)
       if(match == 0) { e = it->second; break; }
     }
   }
+  statAdd(STAT_CMD_LOOKUPS);
+  statAdd(STAT_CMD_SCANNED, scanned);
   if(match != 0) { return 0; }
 
   return e;
@@ -637,23 +828,24 @@ CmdExec::lexOptions
 CmdExecStatus
 CmdExec::errorOption(CmdOptionError err, const string& opt) const
 {
+   ostream& os = cmdErr();
    switch (err) {
       case CMD_OPT_MISSING:
-         cerr << "Error: Missing option";
-         if (opt.size()) cerr << " after (" << opt << ")";
-         cerr << "!!" << endl;
+         os << "Error: Missing option";
+         if (opt.size()) os << " after (" << opt << ")";
+         os << "!!" << endl;
       break;
       case CMD_OPT_EXTRA:
-         cerr << "Error: Extra option!! (" << opt << ")" << endl;
+         os << "Error: Extra option!! (" << opt << ")" << endl;
       break;
       case CMD_OPT_ILLEGAL:
-         cerr << "Error: Illegal option!! (" << opt << ")" << endl;
+         os << "Error: Illegal option!! (" << opt << ")" << endl;
       break;
       case CMD_OPT_FOPEN_FAIL:
-         cerr << "Error: cannot open file \"" << opt << "\"!!" << endl;
+         os << "Error: cannot open file \"" << opt << "\"!!" << endl;
       break;
       default:
-         cerr << "Error: Unknown option error type!! (" << err << ")" << endl;
+         os << "Error: Unknown option error type!! (" << err << ")" << endl;
       exit(-1);
    }
    return CMD_EXEC_ERROR;
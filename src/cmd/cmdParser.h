@@ -13,9 +13,16 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <memory>
 #include <stack>
+#include <queue>
+#include <deque>
+#include <atomic>
+#include <mutex>
+#include <chrono>
 
 #include "cmdCharDef.h"
+#include "myAlloc.h"
 
 using namespace std;
 
@@ -25,12 +32,21 @@ using namespace std;
 
 class CmdExec;
 class CmdParser;
+class CmdPkg;
+class CmdCache;
+class CmdScript;
+class CmdTraceSpan;
+class CmdDofileCache;
+class CmdNode;
+class CmdPool;
 
 
 //----------------------------------------------------------------------
 //    External declaration
 //----------------------------------------------------------------------
 extern CmdParser* cmdMgr;
+// cin reads the terminal as myEventLoop() finds it ready (cmdCharDef.cpp)
+extern void initTermInput();
 
 
 //----------------------------------------------------------------------
@@ -42,11 +58,14 @@ enum CmdExecStatus
    CMD_EXEC_ERROR = 1,
    CMD_EXEC_QUIT  = 2,
    CMD_EXEC_NOP   = 3,
+   CMD_EXEC_INTERRUPTED = 4,         // cancelled (see cmdInterrupted())
 
    // dummy
    CMD_EXEC_TOT
 };
 
+extern const char* cmdStatusStr[CMD_EXEC_TOT];   // "DONE", "ERROR", ...
+
 enum CmdOptionError
 {
    CMD_OPT_MISSING    = 0,
@@ -59,14 +78,79 @@ enum CmdOptionError
 };
 
 
+//----------------------------------------------------------------------
+//    Cooperative cancellation, in cmdCancel.cpp
+//----------------------------------------------------------------------
+// cmdCancel is set by SIGINT (Ctrl-C), or by SIGALRM when the time budget
+// of the running command runs out. A command that may run for long should
+// poll cmdInterrupted() and return CMD_EXEC_INTERRUPTED when it is true.
+// CmdParser then stops the dofiles and clears cmdCancel.
+//
+enum CmdCancelReason
+{
+   CMD_CANCEL_NONE   = 0,
+   CMD_CANCEL_SIGINT = 1,
+   CMD_CANCEL_BUDGET = 2
+};
+
+extern atomic<int> cmdCancel;
+extern void initCmdCancel();         // install the signal handlers
+
+inline bool
+cmdInterrupted()
+{
+   return cmdCancel.load(memory_order_relaxed) != CMD_CANCEL_NONE;
+}
+
+// Arms SIGALRM for "ms" milliseconds (0: no budget) until destructed.
+// A nested budget cannot extend the one it runs within. Those of the
+// threads of DOPARallel are kept together; the earliest is armed. Not
+// armed in the tasks of DOInterleave, which counts as one command.
+class CmdDeadline
+{
+public:
+   CmdDeadline(unsigned ms);
+   ~CmdDeadline();
+
+private:
+   CmdDeadline(const CmdDeadline&);
+   CmdDeadline& operator = (const CmdDeadline&);
+
+   bool                              _armed;
+   chrono::steady_clock::time_point  _at;
+};
+
+
+
+//----------------------------------------------------------------------
+//    Waits of interleaved commands, in cmdTask.cpp
+//----------------------------------------------------------------------
+// A command waiting for I/O should wait with these, so that the other
+// tasks of DOInterleave run meanwhile (see cmdTask.h); outside of a task
+// they block, serving myEventLoop() on the main thread. Both return false
+// if cancelled, and cmdAwaitFd() also on timeout ("ms" < 0: none).
+// "events" are those of poll().
+//
+extern bool cmdAwaitFd(int fd, short events, int ms = -1);
+extern bool cmdAwaitUntil(const chrono::steady_clock::time_point& t);
+extern bool cmdInTask();
+
+
 //----------------------------------------------------------------------
 //    Base class : CmdExec
 //----------------------------------------------------------------------
+// The objects a command reads and writes, named by strings of the
+// package's choice (e.g. "db:" + name)
+struct CmdAccess
+{
+   vector<string>  _reads;
+   vector<string>  _writes;
+};
 
 class CmdExec
 {
 public:
-   CmdExec() {}
+   CmdExec() : _pure(false), _epoch(0) {}
    virtual ~CmdExec() {}
 
    virtual CmdExecStatus exec(const string&) = 0;
@@ -76,6 +160,23 @@ public:
    void setOptCmd(const string& str) { _optCmd = str; }
    const string& getOptCmd() const { return _optCmd; }
 
+   // A pure command prints the same and returns the same status for the
+   // same options as long as "*epoch" is unchanged (0: never changes), so
+   // its results can be replayed from CmdParser's CmdCache. The owner of
+   // the state it reads bumps "*epoch" whenever the state changes.
+   void setPure(const size_t* epoch = 0) { _pure = true; _epoch = epoch; }
+   bool isPure() const { return _pure; }
+   size_t getEpoch() const { return _epoch? *_epoch: 0; }
+
+   // Fill "acc" with what running on "option" reads and writes, so that
+   // DOPARallel can run it on a thread of its pool alongside commands on
+   // other objects; it must not read cin or open dofiles then, and should
+   // print to cmdOut() and cmdErr(). Return false (the default) if it
+   // cannot tell; it then runs alone, after the lines before it and
+   // before those after it.
+   virtual bool getAccess(const string& option, CmdAccess& acc) const {
+      return false; }
+
 protected:
    bool lexNoOption(const string&) const;
    bool lexSingleOption(const string&, string&, bool optional = true) const;
@@ -84,8 +185,38 @@ protected:
 
 private:
    string            _optCmd;
+   bool              _pure;
+   const size_t*     _epoch;
 };
 
+// The streams a command prints to: cout and cerr, except on the threads
+// of DOPARallel, where each has streams of its own, with their own
+// formatting state (in cmdParallel.cpp)
+extern ostream& cmdOut();
+extern ostream& cmdErr();
+
+
+//----------------------------------------------------------------------
+//    Class : CmdRedirect
+//----------------------------------------------------------------------
+// Points stream "s" at "buf" while it exists, and back at the streambuf
+// it had when destructed, also if a command throws.
+//
+class CmdRedirect
+{
+public:
+   CmdRedirect(ios& s, streambuf* buf) : _s(s), _to(s.rdbuf(buf)) {}
+   ~CmdRedirect() { _s.rdbuf(_to); }
+
+private:
+   CmdRedirect(const CmdRedirect&);
+   CmdRedirect& operator = (const CmdRedirect&);
+
+   ios&        _s;
+   streambuf*  _to;                  // replaced streambuf
+};
+
+
 #define CmdClass(T)                           \
 class T: public CmdExec                       \
 {                                             \
@@ -97,6 +228,95 @@ public:                                       \
    void help() const;                         \
 }
 
+// A command that tells DOPARallel what it accesses (see getAccess())
+#define CmdAccessClass(T)                     \
+class T: public CmdExec                       \
+{                                             \
+public:                                       \
+   T() {}                                     \
+   ~T() {}                                    \
+   CmdExecStatus exec(const string& option);  \
+   void usage(ostream& os) const;             \
+   void help() const;                         \
+   bool getAccess(const string& option, CmdAccess& acc) const; \
+}
+
+// Entry point of a command package, "<pkg>_initCmdPkg()", which registers
+// its commands. It is looked up by name, in the executable if the package
+// is linked in, or in lib<pkg>.so otherwise (see CmdParser::loadPkg()).
+#define CmdPkgEntry(pkg, initFunc)            \
+extern "C" bool pkg##_initCmdPkg()            \
+{                                             \
+   return initFunc();                         \
+}
+
+
+//----------------------------------------------------------------------
+//    Base class : CmdSnapshot
+//----------------------------------------------------------------------
+// The state of a package kept by SAVEsession and restored by LOADsession
+// (see cmdSession.h). A package registers one with
+// CmdParser::regSnapshot() when it is loaded. load() gets the bytes that
+// save() wrote, valid during the call only; the package versions them
+// itself.
+//
+class CmdSnapshot
+{
+public:
+   virtual ~CmdSnapshot() {}
+
+   virtual bool save(string& data) const = 0;
+   virtual bool load(const char* data, size_t size) = 0;
+};
+
+
+//----------------------------------------------------------------------
+//    Class : CmdLineBuf
+//----------------------------------------------------------------------
+// Gap buffer for the line being edited. The text before the cursor is
+// kept at the front of _buf and the text after it at the back, so that
+// inserting or deleting at the cursor does not move the rest of the line.
+// The buffer is allocated on the first insertion and doubled on demand.
+//
+class CmdLineBuf
+{
+#define LINE_BUF_INIT_SIZE  128
+#define LINE_BUF_KEEP_SIZE  4096
+
+public:
+   CmdLineBuf() : _buf(0), _cap(0), _gapBegin(0), _gapEnd(0), _dirty(0) {}
+   ~CmdLineBuf() { delete [] _buf; }
+
+   size_t size() const { return _cap - (_gapEnd - _gapBegin); }
+   size_t cursor() const { return _gapBegin; }
+   char operator [] (size_t i) const {
+      return (i < _gapBegin)? _buf[i]: _buf[i + _gapEnd - _gapBegin]; }
+
+   void insert(char ch, size_t repeat = 1);
+   void insert(const string& str);
+   bool erase();
+   bool moveTo(size_t pos);
+   void clear();
+   void assign(const string& str);
+   void append(string& str, size_t b, size_t e) const;
+   string str() const { string s; append(s, 0, size()); return s; }
+
+   // _dirty is the first position that may have changed since markClean()
+   size_t dirty() const { return _dirty; }
+   void markClean() { _dirty = size(); }
+
+private:
+   CmdLineBuf(const CmdLineBuf&);
+   CmdLineBuf& operator = (const CmdLineBuf&);
+   void reserve(size_t n);
+
+   char*     _buf;
+   size_t    _cap;
+   size_t    _gapBegin;              // == cursor position
+   size_t    _gapEnd;
+   size_t    _dirty;
+};
+
 
 //----------------------------------------------------------------------
 //    Base class : CmdParser
@@ -104,65 +324,150 @@ public:                                       \
 
 class CmdParser
 {
-#define READ_BUF_SIZE    65536
 #define PG_OFFSET        10
+#define DOFILE_MAX_DEPTH 1024
 
 typedef map<const string, CmdExec*>   CmdMap;
 typedef pair<const string, CmdExec*>  CmdRegPair;
+typedef shared_ptr<const CmdMap>      CmdMapPtr;
+
+friend class CmdScript;
+friend class CmdScheduler;
+friend class CmdPool;
+friend class CmdPkgStub;
+
+   // The commands are published as immutable CmdMap snapshots, so that
+   // any thread can look them up without a lock while regCmd() publishes
+   // a new one. A reader holds a CmdMapRef while it uses the snapshot,
+   // which shares its ownership; a replaced snapshot is deleted when its
+   // last reader is done with it (see publishCmdMap()).
+   class CmdMapRef
+   {
+   public:
+      CmdMapRef(const CmdParser* p) : _map(atomic_load(&p->_cmdMap)) {}
+
+      const CmdMap& operator * () const { return *_map; }
+      const CmdMap* operator -> () const { return _map.get(); }
+
+   private:
+      CmdMapPtr         _map;
+   };
 
 public:
-   CmdParser(const string& p) : _prompt(p), _dofile(0),
-        _readBufPtr(_readBuf), _readBufEnd(_readBuf),
-        _historyIdx(0), _tabPressCount(0), _tempCmdStored(false) {}
-   virtual ~CmdParser() {}
+   CmdParser(const string& p) : _prompt(p), _dofile(0), _dofileLine(0),
+        _historyIdx(0), _tabPressCount(0), _tempCmdStored(false),
+        _shownCursor(0), _cmdMap(new CmdMap), _cmdEpoch(0), _cache(0),
+        _pasteRestCursor(0), _script(0), _dofileCache(0), _budget(0),
+        _lastCancel(CMD_CANCEL_NONE), _numExecs(0) {}
+   virtual ~CmdParser();
 
    bool openDofile(const string& dof);
+   bool openDofile(istream* dofile, const string& name);
    void closeDofile();
 
    bool regCmd(const string&, unsigned, CmdExec*);
+   // Bumped whenever the registered commands change
+   const size_t* getCmdEpoch() const { return &_cmdEpoch; }
+   // Commands executed so far, on any thread (see execCmd())
+   size_t getNumExecs() const { return _numExecs.load(memory_order_relaxed); }
+   // command packages, in cmdPkg.cpp
+   void setPkgDir(const string& dir) { _pkgDir = dir; }
+   bool addPkg(const string&);
+   bool loadPkg(const string&);
+   bool initPkgs();
+   bool loadPkgs();
+   bool pkgsPending() const;
+   void printPkgs() const;
+
+   // result cache of pure commands, in cmdCache.cpp
+   CmdCache* getCache();
    CmdExecStatus execOneCmd();
-   void printHelps() const;
+   CmdExecStatus execCmdLine(const string&);
+   // machine protocol mode, in cmdProtocol.cpp
+   CmdExecStatus execCaptured(const string&, string& out, string& err);
+   CmdExecStatus execProtocol(int in, int out);
+   bool execShm(const string& file);
+   // dependency-aware parallel dofiles, in cmdParallel.cpp
+   bool execParallel(const string& file, unsigned jobs,
+                     CmdExecStatus& status);
+   // session files, in cmdSession.cpp
+   bool regSnapshot(const string& pkg, CmdSnapshot* s);
+   bool saveSession(const string& file) const;
+   bool loadSession(const string& file);
+   bool inDofile() const { return _dofile != 0; }
+   void printHelps();
 
    // public helper functions
    void printHistory(int nPrint = -1) const;
+   void printStats() const;
+   void printAllocs(bool reset);
+   // time budgets and cancellation, in cmdCancel.cpp
+   void setBudget(unsigned ms, const CmdExec* e = 0);
+   void printBudgets() const;
    CmdExec* getCmd(string);
+   string getCmdName(const CmdExec*) const;
 
 private:
    // Private member functions
    void resetBufAndPrintPrompt() {
-        _readBufPtr = _readBufEnd = _readBuf;
-        *_readBufPtr = 0;
+        _readBuf.clear();
         _tabPressCount = 0;
+        _shownLine.clear();
+        _shownCursor = 0;
         printPrompt();
    }
-   ParseChar getChar(istream&) const;
+   ParseChar getChar(istream&);
+   void readPaste(istream&);
    bool readCmd(istream&);
-   CmdExec* parseCmd(string&);
+   CmdExec* parseCmd(const string&, string&);
+   CmdExec* findCmd(const string&) const;
+   void publishCmdMap(const CmdMap*);
+   CmdExecStatus execCmd(CmdExec*, const string&, AllocStats* = 0);
    void listCmd(const string&);
+   // script variables and blocks, in cmdScript.cpp
+   CmdScript* getScript();
+   CmdExecStatus execLine(istream*);
+   // dofile content cache, in cmdDofile.cpp
+   CmdDofileCache* getDofileCache();
+   void pushDofile(istream* dofile, const string& name, size_t line);
+   // dependency-aware parallel dofiles, in cmdParallel.cpp
+   CmdExecStatus printNodes(deque<CmdNode*>& nodes, size_t& first,
+                            size_t keep, CmdPool& pool);
+   CmdExecStatus execBarrier(const string& text, const string& name,
+                             size_t line);
+   unsigned getBudget(const CmdExec*) const;
+   CmdExecStatus interrupted();
+   // Chrome trace spans, in cmdTrace.cpp
+   void traceCmd(CmdTraceSpan&) const;
    void printPrompt() const { cout << _prompt; }
 
    // Helper functions
-   bool moveBufPtr(char* const);
+   bool moveBufPtr(size_t);
+   size_t wordPos(bool forward) const;
    bool deleteChar();
    void insertChar(char, int = 1);
    void deleteLine();
    void reprintCmd();
+   void refreshLine();
+   void moveCursor(string&, size_t, size_t) const;
    void moveToHistory(int index);
    bool addHistory();
    void retrieveHistory();
+   bool insertPaste();
+   bool readPastedCmd();
    #ifdef TA_KB_SETTING
    void taTestOnly() {}
    #endif
 
    // Data members
    const string _prompt;             // command prompt
-   ifstream* _dofile;                // for command script
-   char      _readBuf[READ_BUF_SIZE];// save the current line input
-                                     // be consistent as shown on the screen
-   char*     _readBufPtr;            // point to the cursor position
-                                     // also be the insert and delete point
-   char*     _readBufEnd;            // end of string position of _readBuf
-                                     // make sure *_readBufEnd = 0
+   istream*  _dofile;                // for command script
+   string    _dofileName;            // path of _dofile
+   size_t    _dofileLine;            // lines read from _dofile
+   CmdLineBuf _readBuf;              // save the current line input
+                                     // _readBuf.cursor() is the cursor
+                                     // position, also the insert and
+                                     // delete point
    vector<string>   _history;        // oldest:_history[0],latest:_hist.back()
    int       _historyIdx;            // (1) Position to insert history string
                                      //     i.e. _historyIdx = _history.size()
@@ -173,8 +478,35 @@ private:
                                      // will be stored in _history and
                                      // _tempCmdStored will be true.
                                      // Reset to false when new command added
-   CmdMap    _cmdMap;                // map from string to command
-   stack<ifstream*> _dofileStack;    // For recursive dofile calling
+   string    _shownLine;             // the line as currently on the screen
+   size_t    _shownCursor;           // cursor position on the screen
+                                     // refreshLine() syncs both to _readBuf
+   CmdMapPtr _cmdMap;                // map from string to command;
+                                     // accessed by atomic_load/store
+   mutex     _cmdMapMutex;           // serializes the writers of _cmdMap
+   size_t    _cmdEpoch;              // of _cmdMap (see getCmdEpoch())
+   vector<CmdPkg*> _pkgs;            // packages added by addPkg()
+   mutable recursive_mutex _pkgMutex;  // guards _pkgs; packages can be
+                                     // initialized by getCmd() on any thread
+   string    _pkgDir;                // where lib<pkg>.so and <pkg>.cmds are
+   CmdCache* _cache;                 // created by the first pure command
+   stack<istream*> _dofileStack;     // For recursive dofile calling
+   stack<pair<string, size_t> > _dofilePosStack;  // _dofileName and
+                                     // _dofileLine of _dofileStack
+   string    _pasteBuf;              // text of the last bracketed paste
+   queue<string> _pasteCmds;         // complete lines of a multi-line paste
+                                     // that are waiting to be executed
+   string    _pasteRest;             // unfinished last line of the paste
+   size_t    _pasteRestCursor;       // cursor position in _pasteRest
+   CmdScript* _script;               // created by the first script line
+   map<const CmdExec*, AllocStats> _allocStats;  // allocations made by
+                                     // each command (see execCmd())
+   CmdDofileCache* _dofileCache;     // created by the first openDofile()
+   unsigned  _budget;                // ms for each command; 0: no limit
+   map<const CmdExec*, unsigned> _budgets;  // ms for specific commands
+   int       _lastCancel;            // reason of the last interrupted()
+   map<string, CmdSnapshot*> _snapshots;  // of each package, by name
+   atomic<size_t> _numExecs;         // by execCmd()
 };
 
 
@@ -0,0 +1,251 @@
+/****************************************************************************
+  FileName     [ cmdPkg.cpp ]
+  PackageName  [ cmd ]
+  Synopsis     [ Define member functions for loadable command packages ]
+  Author       [ Chung-Yang (Ric) Huang ]
+  Copyright    [ Copyleft(c) 2007-present LaDs(III), GIEE, NTU, Taiwan ]
+****************************************************************************/
+#include <dlfcn.h>
+#include <iomanip>
+#include "util.h"
+#include "cmdPkg.h"
+
+using namespace std;
+
+//----------------------------------------------------------------------
+//    Global static funcitons
+//----------------------------------------------------------------------
+static string
+pkgPath(const string& dir, const string& file)
+{
+   return dir.empty()? file: dir + "/" + file;
+}
+
+static string
+entryName(const string& pkg)
+{
+   return pkg + "_initCmdPkg";
+}
+
+
+//----------------------------------------------------------------------
+//    Member Function for class CmdPkg
+//----------------------------------------------------------------------
+// The shared object (if any) is not closed; the command objects of the
+// package are still referred to by CmdParser::_cmdMap.
+CmdPkg::~CmdPkg()
+{
+   for (size_t i = 0, n = _stubs.size(); i < n; ++i)
+      delete _stubs[i];
+}
+
+
+//----------------------------------------------------------------------
+//    Member Function for class CmdParser
+//----------------------------------------------------------------------
+// Add the package "name" without loading it. If its entry point is not
+// linked into the executable and "<name>.cmds" is found in _pkgDir, the
+// commands listed there are registered as CmdPkgStub's.
+//
+// Return false if the package has been added.
+bool
+CmdParser::addPkg(const string& name)
+{
+   lock_guard<recursive_mutex> lock(_pkgMutex);
+   for (size_t i = 0, n = _pkgs.size(); i < n; ++i)
+      if (_pkgs[i]->_name == name) return false;
+
+   CmdPkg* pkg = new CmdPkg(name);
+   _pkgs.push_back(pkg);
+   pkg->_linked = (dlsym(RTLD_DEFAULT, entryName(name).c_str()) != 0);
+   if (pkg->_linked) return true;
+
+   string file = pkgPath(_pkgDir, name + ".cmds");
+   ifstream manifest(file.c_str());
+   string line;
+   while (getline(manifest, line)) {
+      string cmd, token;
+      size_t n = myStrGetTok(line, cmd);
+      if (cmd.empty() || cmd[0] == '#') continue;
+      myStrGetTok(line, token, n);
+      int nCmp;
+      if (!myStr2Int(token, nCmp) || nCmp <= 0 || size_t(nCmp) > cmd.size()) {
+         cerr << "Error: illegal line in \"" << file << "\"!! ("
+              << line << ")" << endl;
+         continue;
+      }
+      CmdExec* stub = new CmdPkgStub(name, cmd);
+      if (!regCmd(cmd, nCmp, stub)) {
+         cerr << "Error: cannot register command \"" << cmd
+              << "\" of package \"" << name << "\"!!" << endl;
+         delete stub;
+         continue;
+      }
+      string key = cmd.substr(0, nCmp);
+      for (size_t i = 0; i < key.size(); ++i)
+         key[i] = toupper(key[i]);
+      pkg->_stubs.push_back(stub);
+      pkg->_stubKeys.push_back(key);
+   }
+   return true;
+}
+
+// Register the commands of package "name" by calling its entry point;
+// "lib<name>.so" in _pkgDir is loaded if the entry point is not linked in.
+// The package is added first if needed.
+//
+// Return false if the package cannot be loaded or fails to initialize.
+bool
+CmdParser::loadPkg(const string& name)
+{
+   lock_guard<recursive_mutex> lock(_pkgMutex);
+   CmdPkg* pkg = 0;
+   for (size_t i = 0, n = _pkgs.size(); i < n && !pkg; ++i)
+      if (_pkgs[i]->_name == name) pkg = _pkgs[i];
+   if (pkg == 0) {
+      addPkg(name);
+      pkg = _pkgs.back();
+   }
+   if (pkg->_loaded) return true;
+
+   string entry = entryName(name);
+   void* sym = dlsym(RTLD_DEFAULT, entry.c_str());
+   if (sym == 0) {
+      string file = pkgPath(_pkgDir, "lib" + name + ".so");
+      if (pkg->_handle == 0)
+         pkg->_handle = dlopen(file.c_str(), RTLD_NOW | RTLD_GLOBAL);
+      if (pkg->_handle == 0) {
+         cerr << "Error: cannot load package \"" << name << "\"!! ("
+              << dlerror() << ")" << endl;
+         return false;
+      }
+      sym = dlsym(pkg->_handle, entry.c_str());
+      if (sym == 0) {
+         cerr << "Error: no \"" << entry << "\" in \"" << file << "\"!!"
+              << endl;
+         return false;
+      }
+   }
+
+   // Make room for the real commands
+   {
+      lock_guard<mutex> lock(_cmdMapMutex);
+      CmdMap* cmdMap = new CmdMap(*_cmdMap);
+      for (size_t i = 0, n = pkg->_stubKeys.size(); i < n; ++i)
+         cmdMap->erase(pkg->_stubKeys[i]);
+      publishCmdMap(cmdMap);
+   }
+   // Set during init() too, so that its lookups do not load it again
+   pkg->_loaded = true;
+
+   bool (*init)() = reinterpret_cast<bool (*)()>(sym);
+   if (init()) return true;
+   cerr << "Error: package \"" << name << "\" fails to initialize!!" << endl;
+
+   // Put the stubs back where init() has not registered a command, so that
+   // the package can be loaded again
+   pkg->_loaded = false;
+   {
+      lock_guard<mutex> lock(_cmdMapMutex);
+      CmdMap* cmdMap = new CmdMap(*_cmdMap);
+      for (size_t i = 0, n = pkg->_stubKeys.size(); i < n; ++i)
+         cmdMap->insert(CmdRegPair(pkg->_stubKeys[i], pkg->_stubs[i]));
+      publishCmdMap(cmdMap);
+   }
+   return false;
+}
+
+// Load the packages that have no manifest, i.e. whose commands are not
+// known until they are loaded. Return false if any of them fails.
+bool
+CmdParser::initPkgs()
+{
+   lock_guard<recursive_mutex> lock(_pkgMutex);
+   bool ok = true;
+   for (size_t i = 0; i < _pkgs.size(); ++i)
+      if (!_pkgs[i]->_loaded && !_pkgs[i]->hasManifest())
+         if (!loadPkg(_pkgs[i]->_name)) ok = false;
+   return ok;
+}
+
+// Load all the packages. Return false if any of them fails.
+bool
+CmdParser::loadPkgs()
+{
+   lock_guard<recursive_mutex> lock(_pkgMutex);
+   bool ok = true;
+   for (size_t i = 0; i < _pkgs.size(); ++i)
+      if (!loadPkg(_pkgs[i]->_name)) ok = false;
+   return ok;
+}
+
+// Return true if some package without a manifest is not loaded yet
+bool
+CmdParser::pkgsPending() const
+{
+   lock_guard<recursive_mutex> lock(_pkgMutex);
+   for (size_t i = 0, n = _pkgs.size(); i < n; ++i)
+      if (!_pkgs[i]->_loaded && !_pkgs[i]->hasManifest())
+         return true;
+   return false;
+}
+
+void
+CmdParser::printPkgs() const
+{
+   lock_guard<recursive_mutex> lock(_pkgMutex);
+   ostream& out = cmdOut();
+   if (_pkgs.empty()) {
+      out << "No command package!!" << endl;
+      return;
+   }
+   for (size_t i = 0, n = _pkgs.size(); i < n; ++i) {
+      const CmdPkg* pkg = _pkgs[i];
+      out << setw(16) << left << pkg->_name
+          << setw(8) << (pkg->_linked? "linked": "shared")
+          << (pkg->_loaded? "loaded": "not loaded");
+      if (pkg->hasManifest())
+         out << " (" << pkg->_stubs.size() << " commands in manifest)";
+      out << endl;
+   }
+}
+
+
+//----------------------------------------------------------------------
+//    Member Function for class CmdPkgStub
+//----------------------------------------------------------------------
+// Load the package and return the real command; 0 if it fails
+CmdExec*
+CmdPkgStub::load() const
+{
+   if (!cmdMgr->loadPkg(_pkg)) return 0;
+   CmdExec* e = cmdMgr->getCmd(_cmd);
+   if (e == 0 || e == this) {
+      cerr << "Error: package \"" << _pkg << "\" does not define command \""
+           << _cmd << "\"!!" << endl;
+      return 0;
+   }
+   return e;
+}
+
+CmdExecStatus
+CmdPkgStub::exec(const string& option)
+{
+   CmdExec* e = load();
+   return e? cmdMgr->execCmd(e, option): CMD_EXEC_ERROR;
+}
+
+// Not loading the package, so that HELp has no side effect
+void
+CmdPkgStub::usage(ostream& os) const
+{
+   os << "Usage: " << _cmd << " (in package " << _pkg << ", not loaded)"
+      << endl;
+}
+
+void
+CmdPkgStub::help() const
+{
+   cout << setw(15) << left << _cmd + ": "
+        << "(in package " << _pkg << ", not loaded)" << endl;
+}
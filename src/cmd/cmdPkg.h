@@ -0,0 +1,71 @@
+/****************************************************************************
+  FileName     [ cmdPkg.h ]
+  PackageName  [ cmd ]
+  Synopsis     [ Define classes for loadable command packages ]
+  Author       [ Chung-Yang (Ric) Huang ]
+  Copyright    [ Copyleft(c) 2007-present LaDs(III), GIEE, NTU, Taiwan ]
+****************************************************************************/
+#ifndef CMD_PKG_H
+#define CMD_PKG_H
+
+#include "cmdParser.h"
+
+//----------------------------------------------------------------------
+//    Class : CmdPkg
+//----------------------------------------------------------------------
+// A command package added by CmdParser::addPkg(). Its commands are
+// registered by calling its entry point "<pkg>_initCmdPkg()", which is
+// either linked into the executable or exported by "lib<pkg>.so".
+//
+// If "<pkg>.cmds" (a manifest of "<cmd> <nCmp>" lines) is found, a
+// CmdPkgStub is registered for each listed command so that the package is
+// loaded only when one of them is first executed. Without a manifest, the
+// package is loaded on the first command lookup that fails.
+//
+class CmdPkg
+{
+   friend class CmdParser;
+
+public:
+   CmdPkg(const string& name) : _name(name), _handle(0), _loaded(false),
+      _linked(false) {}
+   ~CmdPkg();
+
+   const string& getName() const { return _name; }
+   bool hasManifest() const { return !_stubs.empty(); }
+   bool isLoaded() const { return _loaded; }
+
+private:
+   string            _name;
+   void*             _handle;        // from dlopen(); 0 if linked in
+   bool              _loaded;        // entry point has been called
+   bool              _linked;        // entry point found in the executable
+   vector<CmdExec*>  _stubs;         // CmdPkgStub's from the manifest
+   vector<string>    _stubKeys;      // their keys in CmdParser::_cmdMap
+};
+
+//----------------------------------------------------------------------
+//    Class : CmdPkgStub
+//----------------------------------------------------------------------
+// Placeholder for a command of a package that is not loaded yet.
+// Executing it loads the package and runs the real command as any other
+// (see CmdParser::execCmd()); its usage is given without loading.
+//
+class CmdPkgStub : public CmdExec
+{
+public:
+   CmdPkgStub(const string& pkg, const string& cmd) : _pkg(pkg), _cmd(cmd) {}
+   ~CmdPkgStub() {}
+
+   CmdExecStatus exec(const string& option);
+   void usage(ostream& os) const;
+   void help() const;
+
+private:
+   CmdExec* load() const;
+
+   string            _pkg;
+   string            _cmd;           // full command name
+};
+
+#endif // CMD_PKG_H
@@ -0,0 +1,156 @@
+/****************************************************************************
+  FileName     [ cmdProtocol.cpp ]
+  PackageName  [ cmd ]
+  Synopsis     [ Define the line-delimited machine protocol mode ]
+  Author       [ Chung-Yang (Ric) Huang ]
+  Copyright    [ Copyleft(c) 2007-present LaDs(III), GIEE, NTU, Taiwan ]
+****************************************************************************/
+#include <sstream>
+#include <chrono>
+#include <cerrno>
+#include <unistd.h>
+#include "util.h"
+#include "myShm.h"
+#include "cmdProtocol.h"
+
+using namespace std;
+
+//----------------------------------------------------------------------
+//    Member Function for class CmdParser
+//----------------------------------------------------------------------
+// Execute "line" and the dofiles it opens, with what they print to cout
+// and cerr returned in "out" and "err", and cin at end of file.
+// Return the status of "line", or CMD_EXEC_ERROR if a line of the
+// dofiles fails, or the status of the line that quits or is interrupted.
+CmdExecStatus
+CmdParser::execCaptured(const string& line, string& out, string& err)
+{
+   ostringstream outs, errs;
+   istringstream ins;
+   CmdExecStatus result;
+   {
+      CmdRedirect o(cout, outs.rdbuf()), e(cerr, errs.rdbuf()),
+                  i(cin, ins.rdbuf());
+
+      cmdCancel.store(CMD_CANCEL_NONE);
+      result = execCmdLine(line);
+      while (result != CMD_EXEC_QUIT && result != CMD_EXEC_INTERRUPTED &&
+             inDofile()) {
+         CmdExecStatus status = execOneCmd();
+         cout << endl;
+         if (status == CMD_EXEC_ERROR || status == CMD_EXEC_QUIT ||
+             status == CMD_EXEC_INTERRUPTED) result = status;
+      }
+   }
+   out = outs.str();
+   err = errs.str();
+   return result;
+}
+
+// Serve the requests read from file descriptor "in" (see cmdProtocol.h)
+// until the end of file or Quit. Return the status of the last request.
+CmdExecStatus
+CmdParser::execProtocol(int in, int out)
+{
+   CmdProtocol proto(in, out);
+   return proto.serve();
+}
+
+// Serve the requests of the client of the shared-memory channel created
+// in "file" (see myShm.h) until it detaches or Quit.
+// Return false if the channel cannot be created.
+bool
+CmdParser::execShm(const string& file)
+{
+   ShmChannel channel;
+   if (!channel.create(file)) {
+      cerr << "Error: cannot create channel \"" << file << "\"!!" << endl;
+      return false;
+   }
+   string line;
+   ShmReply reply;
+   CmdExecStatus status = CMD_EXEC_DONE;
+   while (status != CMD_EXEC_QUIT && channel.getRequest(line)) {
+      chrono::steady_clock::time_point t = chrono::steady_clock::now();
+      status = execCaptured(line, reply._out, reply._err);
+      reply._status = status;
+      reply._us = chrono::duration_cast<chrono::microseconds>
+                     (chrono::steady_clock::now() - t).count();
+      if (!channel.putReply(reply)) break;
+   }
+   return true;
+}
+
+
+//----------------------------------------------------------------------
+//    Member Function for class CmdProtocol
+//----------------------------------------------------------------------
+CmdExecStatus
+CmdProtocol::serve()
+{
+   string line, id, out, err;
+   CmdExecStatus status = CMD_EXEC_DONE;
+   while (status != CMD_EXEC_QUIT && readLine(line)) {
+      size_t n = myStrGetTok(line, id);
+      if (id.empty()) continue;
+      chrono::steady_clock::time_point t = chrono::steady_clock::now();
+      status = cmdMgr->execCaptured((n == string::npos)? "":
+                                    line.substr(n + 1), out, err);
+      long long us = chrono::duration_cast<chrono::microseconds>
+                        (chrono::steady_clock::now() - t).count();
+
+      _outBuf += id + ' ' + cmdStatusStr[status] + ' ' + to_string(us) +
+                 ' ' + to_string(out.size()) + ' ' + to_string(err.size()) +
+                 '\n';
+      _outBuf += out;
+      _outBuf += err;
+      if (_outBuf.size() >= PROTO_FLUSH_SIZE && !flush()) break;
+   }
+   flush();
+   return status;
+}
+
+// Read the next request into "line". The responses so far are flushed
+// before waiting for more input.
+// Return false at the end of file.
+bool
+CmdProtocol::readLine(string& line)
+{
+   while (true) {
+      size_t e = _inBuf.find('\n', _inPos);
+      if (e != string::npos || (_in < 0 && _inPos < _inBuf.size())) {
+         if (e == string::npos) e = _inBuf.size();
+         line.assign(_inBuf, _inPos, e - _inPos);
+         if (line.size() && line[line.size() - 1] == '\r')
+            line.resize(line.size() - 1);
+         _inPos = e + 1;
+         return true;
+      }
+      if (_in < 0) return false;
+
+      _inBuf.erase(0, _inPos);
+      _inPos = 0;
+      if (!flush()) return false;
+      size_t size = _inBuf.size();
+      _inBuf.resize(size + PROTO_READ_SIZE);
+      ssize_t n = ::read(_in, &_inBuf[size], PROTO_READ_SIZE);
+      _inBuf.resize(size + (n > 0? n: 0));
+      if (n == 0 || (n < 0 && errno != EINTR)) _in = -1;  // end of file
+   }
+}
+
+// Return false if the responses cannot be written
+bool
+CmdProtocol::flush()
+{
+   size_t b = 0;
+   while (b < _outBuf.size()) {
+      ssize_t n = ::write(_out, _outBuf.data() + b, _outBuf.size() - b);
+      if (n < 0 && errno == EINTR) continue;
+      if (n <= 0) break;
+      b += n;
+   }
+   bool ok = (b == _outBuf.size());
+   _outBuf.clear();
+   return ok;
+}
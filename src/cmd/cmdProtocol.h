@@ -0,0 +1,60 @@
+/****************************************************************************
+  FileName     [ cmdProtocol.h ]
+  PackageName  [ cmd ]
+  Synopsis     [ Define class CmdProtocol for the line-delimited machine mode ]
+  Author       [ Chung-Yang (Ric) Huang ]
+  Copyright    [ Copyleft(c) 2007-present LaDs(III), GIEE, NTU, Taiwan ]
+****************************************************************************/
+#ifndef CMD_PROTOCOL_H
+#define CMD_PROTOCOL_H
+
+#include <string>
+#include "cmdParser.h"
+
+using namespace std;
+
+//----------------------------------------------------------------------
+//    Protocol
+//----------------------------------------------------------------------
+// Request:   <id> <command line> '\n'
+// Response:  <id> <status> <us> <nOut> <nErr> '\n' <out> <err>
+//
+// "id" is any token chosen by the driver and echoed back; "status" is
+// DONE, ERROR, QUIT, NOP or INTERRUPTED; "us" the execution time; <out>
+// and <err> are the "nOut" and "nErr" bytes the command printed to cout
+// and cerr, including those of the dofiles it runs. The requests are
+// executed in order, so the responses come in the order of the requests.
+//
+// There is no prompt and no line editor. Requests are read as fast as
+// they arrive, and the responses are only flushed before waiting for
+// more requests, so a driver can keep many requests outstanding. A
+// command never reads the requests as its input (e.g. Quit must be
+// "Quit -Force"); script blocks are not supported.
+//
+
+//----------------------------------------------------------------------
+//    Class : CmdProtocol
+//----------------------------------------------------------------------
+class CmdProtocol
+{
+#define PROTO_READ_SIZE   (1 << 16)
+#define PROTO_FLUSH_SIZE  (1 << 16)
+
+public:
+   CmdProtocol(int in, int out) : _in(in), _out(out), _inPos(0) {}
+   ~CmdProtocol() { flush(); }
+
+   CmdExecStatus serve();
+
+private:
+   bool readLine(string& line);
+   bool flush();
+
+   int       _in;
+   int       _out;
+   string    _inBuf;
+   size_t    _inPos;                 // start of the unread part of _inBuf
+   string    _outBuf;
+};
+
+#endif // CMD_PROTOCOL_H
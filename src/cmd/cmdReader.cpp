@@ -0,0 +1,530 @@
+/****************************************************************************
+  FileName     [ cmdReader.cpp ]
+  PackageName  [ cmd ]
+  Synopsis     [ Define command line reader member functions ]
+  Author       [ Chung-Yang (Ric) Huang ]
+  Copyright    [ Copyleft(c) 2007-present LaDs(III), GIEE, NTU, Taiwan ]
+****************************************************************************/
+#include <cassert>
+#include <cstring>
+#include <ctype.h>
+#include "cmdParser.h"
+
+using namespace std;
+
+//----------------------------------------------------------------------
+//    External functions
+//----------------------------------------------------------------------
+void mybeep();
+void enableBracketedPaste();
+
+
+//----------------------------------------------------------------------
+//    Member Function for class CmdLineBuf
+//----------------------------------------------------------------------
+// Insert 'ch' for "repeat" times at the cursor; the cursor is placed right
+// after the inserted characters. Amortized O(repeat).
+//
+void
+CmdLineBuf::insert(char ch, size_t repeat)
+{
+   if (_gapEnd - _gapBegin < repeat)
+      reserve(size() + repeat);
+   memset(_buf + _gapBegin, ch, repeat);
+   if (_dirty > _gapBegin) _dirty = _gapBegin;
+   _gapBegin += repeat;
+}
+
+// Insert "str" at the cursor; the cursor is placed right after it.
+//
+void
+CmdLineBuf::insert(const string& str)
+{
+   if (_gapEnd - _gapBegin < str.size())
+      reserve(size() + str.size());
+   memcpy(_buf + _gapBegin, str.data(), str.size());
+   if (_dirty > _gapBegin) _dirty = _gapBegin;
+   _gapBegin += str.size();
+}
+
+// Delete the character at the cursor.
+// Return false if the cursor is at the end of the line.
+//
+bool
+CmdLineBuf::erase()
+{
+   if (_gapEnd == _cap) return false;
+   ++_gapEnd;
+   if (_dirty > _gapBegin) _dirty = _gapBegin;
+   return true;
+}
+
+// Move the cursor to "pos" by moving the text between the old and the new
+// positions across the gap. Return false if "pos" is out of range.
+//
+bool
+CmdLineBuf::moveTo(size_t pos)
+{
+   if (pos > size()) return false;
+   if (pos < _gapBegin) {
+      size_t n = _gapBegin - pos;
+      memmove(_buf + _gapEnd - n, _buf + pos, n);
+      _gapBegin -= n; _gapEnd -= n;
+   }
+   else if (pos > _gapBegin) {
+      size_t n = pos - _gapBegin;
+      memmove(_buf + _gapBegin, _buf + _gapEnd, n);
+      _gapBegin += n; _gapEnd += n;
+   }
+   return true;
+}
+
+// Empty the line. A buffer grown beyond LINE_BUF_KEEP_SIZE by an unusually
+// long line is released rather than kept around while idle.
+//
+void
+CmdLineBuf::clear()
+{
+   if (_cap > LINE_BUF_KEEP_SIZE) {
+      delete [] _buf;
+      _buf = 0; _cap = 0;
+   }
+   _gapBegin = 0; _gapEnd = _cap;
+   _dirty = 0;
+}
+
+// Replace the line with "str"; the cursor is placed at the end.
+//
+void
+CmdLineBuf::assign(const string& str)
+{
+   _gapBegin = 0; _gapEnd = _cap;
+   if (_cap < str.size()) reserve(str.size());
+   memcpy(_buf, str.data(), str.size());
+   _gapBegin = str.size();
+   _dirty = 0;
+}
+
+// Append the characters in [b, e) to "str"
+//
+void
+CmdLineBuf::append(string& str, size_t b, size_t e) const
+{
+   assert(b <= e && e <= size());
+   if (b < _gapBegin) {
+      size_t m = (e < _gapBegin)? e: _gapBegin;
+      str.append(_buf + b, m - b);
+      b = m;
+   }
+   if (b < e)
+      str.append(_buf + b + _gapEnd - _gapBegin, e - b);
+}
+
+// Make room for at least "n" characters, keeping the text around the gap
+//
+void
+CmdLineBuf::reserve(size_t n)
+{
+   size_t newCap = (_cap == 0)? LINE_BUF_INIT_SIZE: _cap;
+   while (newCap < n) newCap *= 2;
+   if (newCap == _cap) return;
+   char* newBuf = new char[newCap];
+   size_t tail = _cap - _gapEnd;
+   if (_buf) {
+      memcpy(newBuf, _buf, _gapBegin);
+      memcpy(newBuf + newCap - tail, _buf + _gapEnd, tail);
+      delete [] _buf;
+   }
+   _buf = newBuf;
+   _gapEnd = newCap - tail;
+   _cap = newCap;
+}
+
+
+//----------------------------------------------------------------------
+//    Member Function for class CmdParser
+//----------------------------------------------------------------------
+// The line editing functions (moveBufPtr, insertChar, deleteChar...) only
+// update _readBuf. The screen is brought up to date
+// by refreshLine() once per key event, which compares the buffer against
+// what is currently shown (_shownLine, _shownCursor) and writes only the
+// difference.
+//
+// Lines left over from a multi-line paste are taken before the terminal
+// is read again, unless a dofile is being executed.
+//
+bool
+CmdParser::readCmd(istream& istr)
+{
+   if (&istr == &cin)
+      enableBracketedPaste();
+   resetBufAndPrintPrompt();
+   if (_dofile == 0 && readPastedCmd())
+      return true;
+
+   bool newCmd = false;
+   while (!newCmd) {
+      ParseChar pch = getChar(istr);
+      // Ctrl-C at the prompt discards the line being edited
+      if (&istr == &cin && cmdCancel.load() == CMD_CANCEL_SIGINT) {
+         cmdCancel.store(CMD_CANCEL_NONE);
+         _readBuf.clear();
+         addHistory();               // drops what moveToHistory() stored
+         cout << "^C" << endl;
+         resetBufAndPrintPrompt();
+         continue;
+      }
+      if (pch == INPUT_END_KEY) {
+         if (_dofile != 0)
+            closeDofile();
+         break;
+      }
+      switch (pch) {
+         case LINE_BEGIN_KEY :
+         case HOME_KEY       : moveBufPtr(0); break;
+         case LINE_END_KEY   :
+         case END_KEY        : moveBufPtr(_readBuf.size()); break;
+         case BACK_SPACE_KEY : if (moveBufPtr(_readBuf.cursor() - 1))
+                                  deleteChar();
+                               break;
+         case DELETE_KEY     : deleteChar(); break;
+         case NEWLINE_KEY    : refreshLine();
+                               if (_dofile != 0) ++_dofileLine;
+                               newCmd = addHistory();
+                               cout << char(NEWLINE_KEY);
+                               if (!newCmd) resetBufAndPrintPrompt();
+                               break;
+         case ARROW_UP_KEY   : moveToHistory(_historyIdx - 1); break;
+         case ARROW_DOWN_KEY : moveToHistory(_historyIdx + 1); break;
+         case ARROW_RIGHT_KEY: moveBufPtr(_readBuf.cursor() + 1); break;
+         case ARROW_LEFT_KEY : moveBufPtr(_readBuf.cursor() - 1); break;
+         case WORD_RIGHT_KEY : moveBufPtr(wordPos(true)); break;
+         case WORD_LEFT_KEY  : moveBufPtr(wordPos(false)); break;
+         case PG_UP_KEY      : moveToHistory(_historyIdx - PG_OFFSET); break;
+         case PG_DOWN_KEY    : moveToHistory(_historyIdx + PG_OFFSET); break;
+         case TAB_KEY        : {
+            string str;
+            _readBuf.append(str, 0, _readBuf.cursor());
+            ++_tabPressCount;
+            listCmd(str);
+            break;
+         }
+         case PASTE_KEY      : if (insertPaste() && readPastedCmd())
+                                  return true;
+                               break;
+         case INSERT_KEY     : // not yet supported; fall through to UNDEFINE
+         case UNDEFINED_KEY  : mybeep(); break;
+         default:  // printable character
+            insertChar(char(pch)); break;
+      }
+      if (!newCmd) refreshLine();
+      #ifdef TA_KB_SETTING
+      taTestOnly();
+      #endif
+   }
+   return newCmd;
+}
+
+
+// This function moves the cursor to position "pos"
+// It is used by left/right arrowkeys, home/end, etc.
+// (cursor() - 1 at the beginning of the line wraps to a huge size_t and
+// is rejected as out of range.)
+//
+// Return false if "pos" is out of range; make a beep in this case.
+//
+bool
+CmdParser::moveBufPtr(size_t pos)
+{
+   if (!_readBuf.moveTo(pos)) {
+      mybeep();
+      return false;
+   }
+   return true;
+}
+
+
+// Return the end of the word after the cursor if "forward", or else the
+// beginning of the word before it; words are separated by spaces.
+//
+size_t
+CmdParser::wordPos(bool forward) const
+{
+   size_t pos = _readBuf.cursor();
+   if (forward) {
+      size_t n = _readBuf.size();
+      while (pos < n && _readBuf[pos] == ' ') ++pos;
+      while (pos < n && _readBuf[pos] != ' ') ++pos;
+   }
+   else {
+      while (pos > 0 && _readBuf[pos - 1] == ' ') --pos;
+      while (pos > 0 && _readBuf[pos - 1] != ' ') --pos;
+   }
+   return pos;
+}
+
+
+// Delete the character at the cursor. The cursor stays in place.
+// Return false (and beep) if the cursor is at the end of the line.
+//
+bool
+CmdParser::deleteChar()
+{
+   if (!_readBuf.erase()) {
+      mybeep();
+      return false;
+   }
+   return true;
+}
+
+
+// 1. Insert character 'ch' for "repeat" times at the cursor
+// 2. The cursor is placed right after the inserted characters
+//
+void
+CmdParser::insertChar(char ch, int repeat)
+{
+   assert(repeat >= 1);
+   _readBuf.insert(ch, repeat);
+}
+
+
+// Clear the whole line; the cursor is placed at the beginning.
+//
+void
+CmdParser::deleteLine()
+{
+   _readBuf.clear();
+}
+
+
+// Print the prompt and the current line on a new line, with the cursor
+// placed back at the cursor position.
+//
+void
+CmdParser::reprintCmd()
+{
+   cout << endl;
+   printPrompt();
+   _shownLine.clear();
+   _shownCursor = 0;
+   refreshLine();
+}
+
+
+// This functions moves _historyIdx to index and display _history[index]
+// on the screen.
+//
+// Need to consider:
+// If moving up... (i.e. index < _historyIdx)
+// 1. If already at top (i.e. _historyIdx == 0), beep and do nothing.
+// 2. If at bottom (i.e. _historyIdx == _history.size()) and the current
+//    line has not been stored, store it as a temporary entry.
+// 3. If index < 0, let index = 0.
+//
+// If moving down... (i.e. index > _historyIdx)
+// 1. If already at bottom, beep and do nothing
+// 2. If index >= _history.size(), let index = _history.size() - 1.
+//
+// Moving back to the temporary entry restores the line being edited and
+// drops it from _history.
+//
+void
+CmdParser::moveToHistory(int index)
+{
+   int hSize = _history.size();
+   if (index < _historyIdx) {
+      if (_historyIdx == 0) { mybeep(); return; }
+      if (_historyIdx == hSize) {
+         _history.push_back(_readBuf.str());
+         _tempCmdStored = true;
+      }
+      if (index < 0) index = 0;
+   }
+   else if (index > _historyIdx) {
+      if (!_tempCmdStored || _historyIdx >= hSize - 1) {
+         mybeep(); return;
+      }
+      if (index >= hSize) index = hSize - 1;
+   }
+   else return;
+
+   _historyIdx = index;
+   retrieveHistory();
+   if (_tempCmdStored && _historyIdx == int(_history.size()) - 1) {
+      _history.pop_back();
+      _tempCmdStored = false;
+   }
+}
+
+
+// This function adds the string in _readBuf to the _history.
+// The leading and trailing ' ' are removed. An empty line is not added.
+// Any temporary entry stored by moveToHistory() is dropped.
+//
+// Return true if a new command is added.
+//
+bool
+CmdParser::addHistory()
+{
+   if (_tempCmdStored) {
+      _history.pop_back();
+      _tempCmdStored = false;
+   }
+   _historyIdx = _history.size();
+
+   string str = _readBuf.str();
+   size_t b = str.find_first_not_of(' ');
+   if (b == string::npos) return false;
+   size_t e = str.find_last_not_of(' ');
+   _history.push_back(str.substr(b, e - b + 1));
+   _historyIdx = _history.size();
+   return true;
+}
+
+
+// 1. Replace current line with _history[_historyIdx]
+// 2. Move the cursor to the end of the line
+//
+void
+CmdParser::retrieveHistory()
+{
+   _readBuf.assign(_history[_historyIdx]);
+}
+
+
+// Insert the text of a bracketed paste (_pasteBuf) at the cursor.
+// Tabs become spaces and other non-printable characters are dropped.
+// If the paste contains line breaks, the line being edited is split:
+// the complete lines (the text before the cursor joined with the first
+// pasted line, and the following pasted lines) are queued in _pasteCmds,
+// while the last pasted line joined with the text after the cursor is
+// kept in _pasteRest. Blank lines are skipped.
+//
+// Return true if the paste contains line breaks.
+//
+bool
+CmdParser::insertPaste()
+{
+   vector<string> lines(1);
+   for (size_t i = 0, n = _pasteBuf.size(); i < n; ++i) {
+      char ch = _pasteBuf[i];
+      if (ch == '\r' || ch == '\n') {
+         if (ch == '\n' && i > 0 && _pasteBuf[i - 1] == '\r') continue;
+         lines.push_back("");
+      }
+      else if (ch == '\t') lines.back() += ' ';
+      else if (isprint(ch)) lines.back() += ch;
+   }
+   _pasteBuf.clear();
+
+   if (lines.size() == 1) {
+      if (lines[0].size()) _readBuf.insert(lines[0]);
+      return false;
+   }
+
+   string before, after;
+   _readBuf.append(before, 0, _readBuf.cursor());
+   _readBuf.append(after, _readBuf.cursor(), _readBuf.size());
+   lines[0] = before + lines[0];
+   for (size_t i = 0, n = lines.size() - 1; i < n; ++i)
+      if (lines[i].find_first_not_of(' ') != string::npos)
+         _pasteCmds.push(lines[i]);
+   _pasteRest = lines.back() + after;
+   _pasteRestCursor = lines.back().size();
+   return true;
+}
+
+// Enter the next queued line of a multi-line paste as if it was typed,
+// drawing it in one write. When the queue is empty, the unfinished last
+// line of the paste (if any) is put back on the line being edited.
+//
+// Return true if a command is entered.
+//
+bool
+CmdParser::readPastedCmd()
+{
+   if (_pasteCmds.empty()) {
+      if (_pasteRest.size()) {
+         _readBuf.assign(_pasteRest);
+         _readBuf.moveTo(_pasteRestCursor);
+         _pasteRest.clear();
+         refreshLine();
+      }
+      return false;
+   }
+   _readBuf.assign(_pasteCmds.front());
+   _pasteCmds.pop();
+   refreshLine();
+   cout << char(NEWLINE_KEY);
+   return addHistory();
+}
+
+
+// Bring the screen up to date with _readBuf in one write:
+// 1. Find the first column where _shownLine and _readBuf differ; columns
+//    before _readBuf.dirty() are known to be unchanged
+// 2. Move the cursor there, rewrite the differing tail, and erase what is
+//    left over from the old line
+// 3. Move the cursor to _readBuf.cursor()
+// Cursor motions use backspaces/reprinted characters or "ESC [ n D/C",
+// whichever is shorter.
+//
+void
+CmdParser::refreshLine()
+{
+   size_t newLen = _readBuf.size();
+   size_t newCursor = _readBuf.cursor();
+   size_t oldLen = _shownLine.size();
+
+   size_t diff = _readBuf.dirty();
+   if (diff > oldLen) diff = oldLen;
+   while (diff < oldLen && diff < newLen && _shownLine[diff] == _readBuf[diff])
+      ++diff;
+
+   string out;
+   size_t col = _shownCursor;
+   if (diff < oldLen || diff < newLen) {
+      moveCursor(out, col, diff);
+      _shownLine.resize(diff);
+      _readBuf.append(_shownLine, diff, newLen);
+      out.append(_shownLine, diff, string::npos);
+      col = newLen;
+      if (oldLen > newLen) {
+         // Blanks and backspaces over the rest, or ESC [ K if shorter
+         size_t nErase = oldLen - newLen;
+         const string eraseToEnd = "\033[K";
+         if (2 * nErase > eraseToEnd.size()) out += eraseToEnd;
+         else {
+            out.append(nErase, ' ');
+            out.append(nErase, char(BACK_SPACE_CHAR));
+         }
+      }
+   }
+   moveCursor(out, col, newCursor);
+   _shownCursor = newCursor;
+   _readBuf.markClean();
+
+   if (!out.empty())
+      cout.write(out.data(), out.size());
+}
+
+// Append to "out" the shortest sequence that moves the cursor from column
+// "from" to column "to" on the line shown as _shownLine.
+//
+void
+CmdParser::moveCursor(string& out, size_t from, size_t to) const
+{
+   if (to < from) {
+      size_t n = from - to;
+      string esc = "\033[" + to_string(n) + "D";
+      if (esc.size() < n) out += esc;
+      else out.append(n, char(BACK_SPACE_CHAR));
+   }
+   else if (to > from) {
+      size_t n = to - from;
+      string esc = "\033[" + to_string(n) + "C";
+      if (esc.size() < n) out += esc;
+      else out.append(_shownLine, from, n);
+   }
+}
@@ -0,0 +1,242 @@
+/****************************************************************************
+  FileName     [ cmdRecord.cpp ]
+  PackageName  [ cmd ]
+  Synopsis     [ Define member functions for class CmdRecorder ]
+  Author       [ Chung-Yang (Ric) Huang ]
+  Copyright    [ Copyleft(c) 2007-present LaDs(III), GIEE, NTU, Taiwan ]
+****************************************************************************/
+#include <iostream>
+#include <cstring>
+#include "cmdRecord.h"
+
+using namespace std;
+
+//----------------------------------------------------------------------
+//    Global variable
+//----------------------------------------------------------------------
+CmdRecorder cmdRecorder;
+
+//----------------------------------------------------------------------
+//    Global static funcitons
+//----------------------------------------------------------------------
+static const char recMagic[] = "CMDREC";   // with its '\0'
+
+static void
+putVarint(string& buf, uint64_t n)
+{
+   while (n >= 0x80) {
+      buf += char(n | 0x80);
+      n >>= 7;
+   }
+   buf += char(n);
+}
+
+static void
+putZigzag(string& buf, int64_t n)
+{
+   putVarint(buf, (uint64_t(n) << 1) ^ uint64_t(n >> 63));
+}
+
+// Return false if the varint at "p" runs past "end"
+static bool
+getVarint(const char*& p, const char* end, uint64_t& n)
+{
+   n = 0;
+   for (unsigned shift = 0; p < end && shift < 64; shift += 7) {
+      unsigned char ch = *p++;
+      n |= uint64_t(ch & 0x7f) << shift;
+      if (!(ch & 0x80)) return true;
+   }
+   return false;
+}
+
+static bool
+getString(const char*& p, const char* end, size_t len, string& str)
+{
+   if (size_t(end - p) < len) return false;
+   str.append(p, len);
+   p += len;
+   return true;
+}
+
+
+//----------------------------------------------------------------------
+//    Member Function for class CmdRecorder
+//----------------------------------------------------------------------
+// Start recording to "file"; a recording in progress is stopped first.
+// Return false if "file" cannot be written.
+bool
+CmdRecorder::start(const string& file)
+{
+   stop();
+   _ofs.clear();
+   _ofs.open(file.c_str(), ios::out | ios::trunc | ios::binary);
+   if (!_ofs) return false;
+   _file = file;
+
+   lock_guard<mutex> lock(_mutex);
+   _start = chrono::steady_clock::now();
+   _buf.assign(recMagic, sizeof(recMagic));
+   _buf += char(CMD_REC_VERSION);
+   putVarint(_buf, chrono::duration_cast<chrono::microseconds>
+                (chrono::system_clock::now().time_since_epoch()).count());
+   _ids.clear();
+   _prevTs = 0;
+   _prevLine.clear();
+   _numRecords = 0;
+   _stop = false;
+   _writer = thread(&CmdRecorder::write, this);
+   _on.store(true, memory_order_relaxed);
+   return true;
+}
+
+// Write the pending records and close the log.
+// Return false if it is not recording or the log cannot be written.
+bool
+CmdRecorder::stop()
+{
+   if (!isOn()) return false;
+   {
+      lock_guard<mutex> lock(_mutex);
+      _on.store(false, memory_order_relaxed);
+      _stop = true;
+   }
+   _cond.notify_one();
+   _writer.join();
+   _ofs.close();
+   if (!_ofs) {
+      cerr << "Error: cannot write session log \"" << _file << "\"!!"
+           << endl;
+      return false;
+   }
+   return true;
+}
+
+void
+CmdRecorder::record(const string& line, const CmdExec* e,
+                    CmdExecStatus status, chrono::steady_clock::time_point t,
+                    chrono::steady_clock::time_point end)
+{
+   lock_guard<mutex> lock(_mutex);
+   if (!isOn()) return;
+   // A line started before the recording counts from its start
+   if (t < _start) t = _start;
+   if (end < t) end = t;
+   int64_t ts = chrono::duration_cast<chrono::microseconds>
+                   (t - _start).count();
+   uint64_t dur = chrono::duration_cast<chrono::microseconds>
+                     (end - t).count();
+
+   uint64_t id = 0;
+   if (e != 0) {
+      map<const CmdExec*, uint64_t>::iterator it = _ids.find(e);
+      if (it != _ids.end()) id = it->second;
+      else {
+         const string name = cmdMgr->getCmdName(e);
+         id = _ids.size() + 1;
+         _ids[e] = id;
+         putVarint(_buf, 0);
+         putVarint(_buf, name.size());
+         _buf += name;
+      }
+   }
+   size_t keep = 0, n = min(line.size(), _prevLine.size());
+   while (keep < n && line[keep] == _prevLine[keep]) ++keep;
+
+   putVarint(_buf, id << 3 | uint64_t(status));
+   putZigzag(_buf, ts - _prevTs);
+   putVarint(_buf, dur);
+   putVarint(_buf, keep);
+   putVarint(_buf, line.size() - keep);
+   _buf.append(line, keep, string::npos);
+   _prevTs = ts;
+   _prevLine = line;
+   ++_numRecords;
+   if (_buf.size() >= REC_FLUSH_SIZE) _cond.notify_one();
+}
+
+// The writer thread
+void
+CmdRecorder::write()
+{
+   string out;
+   unique_lock<mutex> lock(_mutex);
+   while (true) {
+      _cond.wait_for(lock, chrono::seconds(1), [this] {
+         return _stop || _buf.size() >= REC_FLUSH_SIZE; });
+      out.swap(_buf);
+      bool stop = _stop;
+      lock.unlock();
+      if (out.size()) {
+         _ofs.write(out.data(), out.size());
+         _ofs.flush();
+         out.clear();
+      }
+      if (stop) return;
+      lock.lock();
+   }
+}
+
+// Read the session log "file" into "recs".
+// Return false if it cannot be read or is not a valid log.
+bool
+CmdRecorder::load(const string& file, vector<CmdRecord>& recs)
+{
+   ifstream ifs(file.c_str(), ios::in | ios::binary);
+   if (!ifs) {
+      cerr << "Error: cannot open session log \"" << file << "\"!!" << endl;
+      return false;
+   }
+   string data((istreambuf_iterator<char>(ifs)), istreambuf_iterator<char>());
+   const char* p = data.data();
+   const char* end = p + data.size();
+   uint64_t startTime;
+   if (data.size() <= sizeof(recMagic) ||
+       memcmp(p, recMagic, sizeof(recMagic)) != 0) {
+      cerr << "Error: \"" << file << "\" is not a session log!!" << endl;
+      return false;
+   }
+   p += sizeof(recMagic);
+   int version = *p++;
+   if (version != CMD_REC_VERSION) {
+      cerr << "Error: unsupported version " << version
+           << " of session log \"" << file << "\"!!" << endl;
+      return false;
+   }
+
+   vector<string> names(1);
+   int64_t ts = 0;
+   string line;
+   bool ok = getVarint(p, end, startTime);
+   while (ok && p < end) {
+      uint64_t head, dt, dur, keep, len;
+      if (!getVarint(p, end, head)) { ok = false; break; }
+      if (head == 0) {
+         names.push_back("");
+         ok = getVarint(p, end, len) && getString(p, end, len, names.back());
+         continue;
+      }
+      if (!(ok = getVarint(p, end, dt) && getVarint(p, end, dur) &&
+                 getVarint(p, end, keep) && getVarint(p, end, len) &&
+                 (head >> 3) < names.size() && keep <= line.size() &&
+                 (head & 7) < CMD_EXEC_TOT))
+         break;
+      line.resize(keep);
+      if (!(ok = getString(p, end, len, line))) break;
+      ts += int64_t(dt >> 1) ^ -int64_t(dt & 1);
+
+      CmdRecord rec;
+      rec._ts = ts;
+      rec._dur = dur;
+      rec._cmd = names[head >> 3];
+      rec._status = CmdExecStatus(head & 7);
+      rec._line = line;
+      recs.push_back(rec);
+   }
+   if (!ok) {
+      cerr << "Error: session log \"" << file << "\" is corrupted after "
+           << recs.size() << " lines!!" << endl;
+      return false;
+   }
+   return true;
+}
@@ -0,0 +1,112 @@
+/****************************************************************************
+  FileName     [ cmdRecord.h ]
+  PackageName  [ cmd ]
+  Synopsis     [ Define class CmdRecorder for binary session logs ]
+  Author       [ Chung-Yang (Ric) Huang ]
+  Copyright    [ Copyleft(c) 2007-present LaDs(III), GIEE, NTU, Taiwan ]
+****************************************************************************/
+#ifndef CMD_RECORD_H
+#define CMD_RECORD_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <fstream>
+#include <cstdint>
+#include "cmdParser.h"
+
+using namespace std;
+
+//----------------------------------------------------------------------
+//    Forward Declaration
+//----------------------------------------------------------------------
+class CmdRecorder;
+
+//----------------------------------------------------------------------
+//    External declaration
+//----------------------------------------------------------------------
+extern CmdRecorder cmdRecorder;
+
+
+//----------------------------------------------------------------------
+//    Session log format
+//----------------------------------------------------------------------
+// "CMDREC" '\0' <version> <varint start time, us since the epoch>
+// followed by records, all numbers being LEB128 varints:
+//
+//    0 <len> <name>                 defines the next command ID (1, 2, ...)
+//    <id << 3 | status> <zigzag dt> <dur> <keep> <len> <text>
+//                                   an executed line: "id" is 0 if it is
+//                                   not a command; "dt" is its start time
+//                                   minus that of the previous line (us);
+//                                   "dur" its execution time (us); the line
+//                                   is the first "keep" chars of the
+//                                   previous line followed by "text"
+//
+#define CMD_REC_VERSION  2
+
+struct CmdRecord
+{
+   double          _ts;              // us since the recording started
+   double          _dur;             // us
+   string          _cmd;             // registered name; "" if not a command
+   CmdExecStatus   _status;
+   string          _line;
+};
+
+
+//----------------------------------------------------------------------
+//    Class : CmdRecorder
+//----------------------------------------------------------------------
+// Encodes the executed command lines and has them appended to the log by
+// a writer thread, which writes whatever has been encoded once a second,
+// or as soon as REC_FLUSH_SIZE bytes are pending.
+//
+class CmdRecorder
+{
+#define REC_FLUSH_SIZE  (1 << 16)
+
+public:
+   CmdRecorder() : _on(false), _stop(false), _prevTs(0), _numRecords(0) {}
+   ~CmdRecorder() { stop(); }
+
+   bool start(const string& file);
+   bool stop();
+   bool isOn() const { return _on.load(memory_order_relaxed); }
+   const string& getFile() const { return _file; }
+   size_t numRecords() const { return _numRecords; }
+
+   // "t" is when the line started to execute, "end" when it ended
+   void record(const string& line, const CmdExec* e, CmdExecStatus status,
+               chrono::steady_clock::time_point t) {
+      if (isOn()) record(line, e, status, t, chrono::steady_clock::now()); }
+   void record(const string& line, const CmdExec* e, CmdExecStatus status,
+               chrono::steady_clock::time_point t,
+               chrono::steady_clock::time_point end);
+
+   static bool load(const string& file, vector<CmdRecord>& recs);
+
+private:
+   void write();
+
+   atomic<bool>                  _on;
+   string                        _file;
+   ofstream                      _ofs;   // written by _writer only
+   thread                        _writer;
+   mutex                         _mutex; // guards the members below
+   condition_variable            _cond;
+   bool                          _stop;
+   string                        _buf;   // encoded, not written yet
+   chrono::steady_clock::time_point _start;
+   map<const CmdExec*, uint64_t> _ids;
+   int64_t                       _prevTs;
+   string                        _prevLine;
+   size_t                        _numRecords;
+};
+
+#endif // CMD_RECORD_H
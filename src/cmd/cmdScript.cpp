@@ -0,0 +1,671 @@
+/****************************************************************************
+  FileName     [ cmdScript.cpp ]
+  PackageName  [ cmd ]
+  Synopsis     [ Define the compiler and interpreter of script blocks ]
+  Author       [ Chung-Yang (Ric) Huang ]
+  Copyright    [ Copyleft(c) 2007-present LaDs(III), GIEE, NTU, Taiwan ]
+****************************************************************************/
+#include <cstring>
+#include <cassert>
+#include "util.h"
+#include "cmdScript.h"
+#include "cmdTrace.h"
+#include "cmdRecord.h"
+
+using namespace std;
+
+//----------------------------------------------------------------------
+//    Global static variables and funcitons
+//----------------------------------------------------------------------
+static const char* sopStr[CMD_SOP_TOT] = {
+   "", "==", "!=", "<", "<=", ">", ">=", "+", "-", "*", "/", "%", "IN"
+};
+
+// Keywords are case-insensitive and cannot be abbreviated
+static bool
+isKey(const string& tok, const char* key)
+{
+   return myStrNCmp(key, tok, strlen(key)) == 0;
+}
+
+static bool
+opensBlock(const string& tok)
+{
+   return isKey(tok, "FOR") || isKey(tok, "WHILE") || isKey(tok, "IF");
+}
+
+// Return the operator in [first, last] spelled "tok"; CMD_SOP_NONE if none
+static CmdScriptOp
+findOp(const string& tok, CmdScriptOp first, CmdScriptOp last)
+{
+   for (int i = first; i <= last; ++i)
+      if (tok == sopStr[i]) return CmdScriptOp(i);
+   return CMD_SOP_NONE;
+}
+
+static void
+splitToks(const string& line, size_t pos, vector<string>& toks)
+{
+   string tok;
+   size_t n = myStrGetTok(line, tok, pos);
+   while (tok.size()) {
+      toks.push_back(tok);
+      n = myStrGetTok(line, tok, n);
+   }
+}
+
+static bool
+isVarChar(char ch)
+{
+   return isalnum(ch) || ch == '_';
+}
+
+
+//----------------------------------------------------------------------
+//    Member Function for class CmdParser
+//----------------------------------------------------------------------
+CmdScript*
+CmdParser::getScript()
+{
+   if (_script == 0) _script = new CmdScript(this);
+   return _script;
+}
+
+// Execute _history.back(), read from "istr" (0: not read from a stream).
+// The lines of a script block are read from "istr" as well.
+CmdExecStatus
+CmdParser::execLine(istream* istr)
+{
+   const string line = _history.back();
+   if (CmdScript::isScriptLine(line)) {
+      CmdTraceSpan span("script");
+      return getScript()->exec(line, istr);
+   }
+
+   string str;
+   if (line.find('$') == string::npos) str = line;
+   else if (!getScript()->subst(line, str)) return CMD_EXEC_ERROR;
+
+   chrono::steady_clock::time_point t;
+   if (cmdRecorder.isOn()) t = chrono::steady_clock::now();
+   string option;
+   CmdExec* e = 0;
+   {
+      CmdTraceSpan parse("parse");
+      e = parseCmd(str, option);
+   }
+   CmdExecStatus status = CMD_EXEC_NOP;
+   if (e != 0) {
+      CmdTraceSpan exec("exec");
+      status = execCmd(e, option);
+   }
+   cmdRecorder.record(str, e, status, t);
+   return status;
+}
+
+
+//----------------------------------------------------------------------
+//    Member Function for class CmdScript
+//----------------------------------------------------------------------
+// Return true if "line" starts with a script keyword
+bool
+CmdScript::isScriptLine(const string& line)
+{
+   string tok;
+   myStrGetTok(line, tok);
+   return opensBlock(tok) || isKey(tok, "SET") || isKey(tok, "ELSE") ||
+          isKey(tok, "END");
+}
+
+// Return 1 if "line" opens a block, -1 if it is an END, and 0 otherwise
+int
+CmdScript::blockDepth(const string& line)
+{
+   string tok;
+   myStrGetTok(line, tok);
+   if (opensBlock(tok)) return 1;
+   return isKey(tok, "END")? -1: 0;
+}
+
+// Execute the SET or the block that starts with "line"
+CmdExecStatus
+CmdScript::exec(const string& line, istream* istr)
+{
+   vector<string> lines;
+   if (!readBlock(line, istr, lines))
+      return CMD_EXEC_ERROR;
+
+   // A command in the block may run a dofile with blocks of its own
+   const vector<string>* src = _src;
+   _src = &lines;
+   CmdProgram prog;
+   CmdExecStatus status = CMD_EXEC_ERROR;
+   if (compile(lines, prog)) {
+      // The block counts as one command for the time budget
+      CmdDeadline deadline(_parser->_budget);
+      status = run(prog, lines);
+      cout.flush();                  // once for all the lines it echoed
+   }
+   _src = src;
+   return status;
+}
+
+// Replace the variables in "str". Return false if any is not set.
+bool
+CmdScript::subst(const string& str, string& res)
+{
+   CmdText text;
+   return compileText(str, text) && render(text, res);
+}
+
+void
+CmdScript::listVars(vector<pair<string, string> >& vars) const
+{
+   for (size_t i = 0, n = _values.size(); i < n; ++i)
+      if (_defined[i]) vars.push_back(make_pair(_varNames[i], _values[i]));
+}
+
+void
+CmdScript::assignVar(const string& name, const string& value)
+{
+   size_t slot = getVar(name);
+   _values[slot] = value;
+   _defined[slot] = true;
+}
+
+// Read the lines of the block up to its END. Return false on end of input.
+bool
+CmdScript::readBlock(const string& first, istream* istr, vector<string>& lines)
+{
+   size_t depth = 0;
+   string line = first;
+   while (true) {
+      string tok;
+      myStrGetTok(line, tok);
+      if (opensBlock(tok)) ++depth;
+      else if (isKey(tok, "END") && depth) --depth;
+      lines.push_back(line);
+      if (depth == 0) return true;
+      if (istr == 0 || !_parser->readCmd(*istr)) {
+         cerr << "Error: missing END of \"" << first << "\"!!" << endl;
+         return false;
+      }
+      line = _parser->_history.back();
+   }
+}
+
+bool
+CmdScript::compile(const vector<string>& lines, CmdProgram& prog)
+{
+   size_t i = 0;
+   if (!compileBlock(lines, i, prog)) return false;
+   if (i < lines.size()) {
+      string tok;
+      myStrGetTok(lines[i], tok);
+      cerr << "Error: \"" << tok << "\" without FOR, WHILE or IF!!" << endl;
+      return false;
+   }
+   return true;
+}
+
+// Compile lines[i] and on into "prog", up to the END or ELSE of the
+// enclosing block, which is left at lines[i].
+bool
+CmdScript::compileBlock(const vector<string>& lines, size_t& i,
+                        CmdProgram& prog)
+{
+   while (i < lines.size()) {
+      const string& line = lines[i];
+      string tok;
+      size_t n = myStrGetTok(line, tok);
+      if (isKey(tok, "END") || isKey(tok, "ELSE")) return true;
+      size_t lineNo = i++;
+      if (isKey(tok, "SET")) {
+         if (!compileSet(line, n, lineNo, prog)) return false;
+         continue;
+      }
+      if (!opensBlock(tok)) {
+         if (!compileExec(line, lineNo, prog)) return false;
+         continue;
+      }
+
+      // FOR:   FOR body NEXT
+      // WHILE: TEST body JUMP
+      // IF:    TEST then [JUMP else]
+      size_t start = prog.size();
+      if (isKey(tok, "FOR")) {
+         if (!compileFor(line, n, lineNo, prog)) return false;
+      }
+      else if (!compileCond(line, n, lineNo, prog)) return false;
+      if (!compileBlock(lines, i, prog)) return false;
+      if (i < lines.size() && isKey(tok, "IF")) {
+         string end;
+         myStrGetTok(lines[i], end);
+         if (isKey(end, "ELSE")) {
+            ++i;
+            size_t jump = prog.size();
+            prog.push_back(CmdInstr(CMD_OP_JUMP, lineNo));
+            prog[start]._jump = prog.size();
+            if (!compileBlock(lines, i, prog)) return false;
+            start = jump;
+         }
+      }
+      if (i == lines.size()) {
+         cerr << "Error: missing END of \"" << line << "\"!!" << endl;
+         return false;
+      }
+      string end;
+      myStrGetTok(lines[i], end);
+      if (!isKey(end, "END")) {
+         cerr << "Error: \"" << end << "\" without IF!!" << endl;
+         return false;
+      }
+      ++i;
+      if (isKey(tok, "FOR")) {
+         prog.push_back(CmdInstr(CMD_OP_NEXT, lineNo));
+         prog.back()._jump = start;
+      }
+      else if (isKey(tok, "WHILE")) {
+         prog.push_back(CmdInstr(CMD_OP_JUMP, lineNo));
+         prog.back()._jump = start;
+      }
+      prog[start]._jump = prog.size();
+   }
+   return true;
+}
+
+// SET <var> [<value>...]; "line" from position "n" on
+bool
+CmdScript::compileSet(const string& line, size_t n, size_t lineNo,
+                      CmdProgram& prog)
+{
+   string name;
+   size_t end = myStrGetTok(line, name, n);
+   if (!isValidVarName(name)) {
+      cerr << "Error: illegal variable name \"" << name << "\"!!" << endl;
+      return false;
+   }
+   CmdInstr in(CMD_OP_SET, lineNo);
+   in._var = getVar(name);
+
+   vector<string> toks;
+   splitToks(line, end, toks);
+   if (toks.size() == 3)
+      in._sop = findOp(toks[1], CMD_SOP_ADD, CMD_SOP_MOD);
+   if (in._sop != CMD_SOP_NONE) {
+      in._args.resize(2);
+      if (!compileText(toks[0], in._args[0]) ||
+          !compileText(toks[2], in._args[1])) return false;
+   }
+   else {
+      in._args.resize(1);
+      size_t b = (end == string::npos)? end: line.find_first_not_of(' ', end);
+      if (!compileText((b == string::npos)? "": line.substr(b), in._args[0]))
+         return false;
+   }
+   prog.push_back(in);
+   return true;
+}
+
+// FOR <var> <from> <to> [<step>] | FOR <var> IN <item>...
+bool
+CmdScript::compileFor(const string& line, size_t n, size_t lineNo,
+                      CmdProgram& prog)
+{
+   string name;
+   size_t end = myStrGetTok(line, name, n);
+   if (!isValidVarName(name)) {
+      cerr << "Error: illegal variable name \"" << name << "\"!!" << endl;
+      return false;
+   }
+   CmdInstr in(CMD_OP_FOR, lineNo);
+   in._var = getVar(name);
+
+   vector<string> toks;
+   splitToks(line, end, toks);
+   size_t b = 0;
+   if (toks.size() && isKey(toks[0], "IN")) {
+      in._sop = CMD_SOP_IN;
+      b = 1;
+   }
+   else if (toks.size() < 2 || toks.size() > 3) {
+      cerr << "Error: illegal range in \"" << line << "\"!!" << endl;
+      return false;
+   }
+   in._args.resize(toks.size() - b);
+   for (size_t i = b; i < toks.size(); ++i)
+      if (!compileText(toks[i], in._args[i - b])) return false;
+   prog.push_back(in);
+   return true;
+}
+
+// WHILE|IF <a> [<op> <b>]
+bool
+CmdScript::compileCond(const string& line, size_t n, size_t lineNo,
+                       CmdProgram& prog)
+{
+   vector<string> toks;
+   splitToks(line, n, toks);
+   CmdInstr in(CMD_OP_TEST, lineNo);
+   if (toks.size() == 3)
+      in._sop = findOp(toks[1], CMD_SOP_EQ, CMD_SOP_GE);
+   if (toks.size() != 1 && in._sop == CMD_SOP_NONE) {
+      cerr << "Error: illegal condition in \"" << line << "\"!!" << endl;
+      return false;
+   }
+   in._args.resize(toks.size() == 1? 1: 2);
+   if (!compileText(toks[0], in._args[0])) return false;
+   if (toks.size() == 3 && !compileText(toks[2], in._args[1])) return false;
+   prog.push_back(in);
+   return true;
+}
+
+// The command is looked up now unless its name contains a variable
+bool
+CmdScript::compileExec(const string& line, size_t lineNo, CmdProgram& prog)
+{
+   CmdInstr in(CMD_OP_EXEC, lineNo);
+   string cmd;
+   size_t end = myStrGetTok(line, cmd);
+   in._args.resize(2);
+   if (!compileText(cmd, in._args[0]) ||
+       !compileText((end == string::npos)? "": line.substr(end), in._args[1]))
+      return false;
+   if (in._args[0].isLiteral())
+      in._cmd = _parser->getCmd(cmd);
+   prog.push_back(in);
+   return true;
+}
+
+// Split "str" at "$var", "${var}" and "$$"
+bool
+CmdScript::compileText(const string& str, CmdText& text)
+{
+   text._lits.assign(1, string());
+   text._vars.clear();
+   size_t i = 0, n = str.size();
+   while (i < n) {
+      size_t d = str.find('$', i);
+      if (d == string::npos) d = n;
+      text._lits.back().append(str, i, d - i);
+      if (d == n) break;
+
+      string name;
+      if (d + 1 < n && str[d + 1] == '$') {
+         text._lits.back() += '$';
+         i = d + 2;
+         continue;
+      }
+      if (d + 1 < n && str[d + 1] == '{') {
+         size_t e = str.find('}', d + 2);
+         if (e != string::npos) name = str.substr(d + 2, e - d - 2);
+         if (!isValidVarName(name)) {
+            cerr << "Error: illegal variable in \"" << str << "\"!!" << endl;
+            return false;
+         }
+         i = e + 1;
+      }
+      else {
+         size_t e = d + 1;
+         while (e < n && isVarChar(str[e])) ++e;
+         name = str.substr(d + 1, e - d - 1);
+         if (!isValidVarName(name)) {   // not a variable; keep the '$'
+            text._lits.back() += '$';
+            i = d + 1;
+            continue;
+         }
+         i = e;
+      }
+      text._vars.push_back(getVar(name));
+      text._lits.push_back(string());
+   }
+   return true;
+}
+
+// Return the slot of variable "name"; a new one if it is not used yet
+size_t
+CmdScript::getVar(const string& name)
+{
+   map<string, size_t>::iterator it = _varIdx.find(name);
+   if (it != _varIdx.end()) return it->second;
+   size_t slot = _values.size();
+   _varIdx[name] = slot;
+   _varNames.push_back(name);
+   _values.push_back(string());
+   _defined.push_back(false);
+   return slot;
+}
+
+// Interpreter loop. A failing instruction does not stop the program,
+// as a failing line does not stop a dofile; QUIT does. Lines end with
+// '\n' and are flushed once by exec(), not on every iteration.
+//
+// Return CMD_EXEC_ERROR if any instruction fails.
+CmdExecStatus
+CmdScript::run(const CmdProgram& prog, const vector<string>& lines)
+{
+   CmdExecStatus result = CMD_EXEC_DONE;
+   vector<CmdLoop> loops(prog.size());
+   size_t pc = 0, n = prog.size();
+   while (pc < n) {
+      if (cmdInterrupted()) return CMD_EXEC_INTERRUPTED;
+      const CmdInstr& in = prog[pc];
+      switch (in._op) {
+         case CMD_OP_EXEC: {
+            CmdExecStatus status = execInstr(in);
+            // Another task of DOInterleave may have run a block meanwhile
+            _src = &lines;
+            if (status == CMD_EXEC_QUIT || status == CMD_EXEC_INTERRUPTED)
+               return status;
+            if (status == CMD_EXEC_ERROR) result = status;
+            cout << '\n';
+            ++pc;
+            break;
+         }
+         case CMD_OP_SET:
+            if (!setVar(in)) result = CMD_EXEC_ERROR;
+            ++pc;
+            break;
+         case CMD_OP_TEST: {
+            bool res = false;
+            if (!test(in, res)) result = CMD_EXEC_ERROR;
+            pc = res? pc + 1: in._jump;
+            break;
+         }
+         case CMD_OP_JUMP:
+            pc = in._jump;
+            break;
+         case CMD_OP_FOR: {
+            CmdLoop& loop = loops[pc];
+            if (!startLoop(in, loop)) {
+               result = CMD_EXEC_ERROR;
+               pc = in._jump;
+            }
+            else if (in._sop == CMD_SOP_IN) {
+               if (loop._items.empty()) pc = in._jump;
+               else {
+                  _values[in._var] = loop._items[0];
+                  _defined[in._var] = true;
+                  ++pc;
+               }
+            }
+            else if (loop._step > 0? loop._cur > loop._to:
+                                     loop._cur < loop._to) pc = in._jump;
+            else {
+               _values[in._var] = to_string(loop._cur);
+               _defined[in._var] = true;
+               ++pc;
+            }
+            break;
+         }
+         case CMD_OP_NEXT: {
+            const CmdInstr& start = prog[in._jump];
+            CmdLoop& loop = loops[in._jump];
+            bool more = false;
+            if (start._sop == CMD_SOP_IN) {
+               more = (++loop._idx < loop._items.size());
+               if (more) _values[start._var] = loop._items[loop._idx];
+            }
+            else {
+               loop._cur += loop._step;
+               more = loop._step > 0? loop._cur <= loop._to:
+                                      loop._cur >= loop._to;
+               if (more) _values[start._var] = to_string(loop._cur);
+            }
+            if (more) _defined[start._var] = true;
+            pc = more? in._jump + 1: pc + 1;
+            break;
+         }
+         default: assert(0); break;
+      }
+   }
+   return result;
+}
+
+// Echo and execute the command line, then the dofile it opens (if any)
+CmdExecStatus
+CmdScript::execInstr(const CmdInstr& in)
+{
+   string cmd, option;
+   if (!render(in._args[0], cmd) || !render(in._args[1], option))
+      return CMD_EXEC_ERROR;
+   cout << _parser->_prompt << cmd << option << '\n';
+
+   chrono::steady_clock::time_point t;
+   if (cmdRecorder.isOn()) t = chrono::steady_clock::now();
+   const string line = cmd + option;
+   CmdExec* e = in._cmd;
+   if (e == 0) {
+      e = _parser->parseCmd(line, option);
+      if (e == 0) {
+         if (cmd.empty()) return CMD_EXEC_NOP;
+         cmdRecorder.record(line, 0, CMD_EXEC_NOP, t);
+         return CMD_EXEC_ERROR;
+      }
+   }
+   size_t depth = _parser->_dofileStack.size();
+   CmdExecStatus status = CMD_EXEC_DONE;
+   {
+      CmdTraceSpan span("exec");
+      if (span.isOn()) {
+         span.setName(cmd);
+         span.addArg("options", option);
+         span.addArg("depth", depth);
+      }
+      status = _parser->execCmd(e, option);
+   }
+   cmdRecorder.record(line, e, status, t);
+   while (status != CMD_EXEC_QUIT && status != CMD_EXEC_INTERRUPTED &&
+          !cmdInterrupted() && _parser->_dofileStack.size() > depth) {
+      status = _parser->execOneCmd();
+      cout << '\n';
+   }
+   return status;
+}
+
+bool
+CmdScript::setVar(const CmdInstr& in)
+{
+   string a;
+   if (!render(in._args[0], a)) return false;
+   if (in._sop != CMD_SOP_NONE) {
+      string b;
+      if (!render(in._args[1], b)) return false;
+      int x, y;
+      if (myStr2Int(a, x) && myStr2Int(b, y)) {
+         if (y == 0 && (in._sop == CMD_SOP_DIV || in._sop == CMD_SOP_MOD)) {
+            cerr << "Error: division by zero in \"" << (*_src)[in._line]
+                 << "\"!!" << endl;
+            return false;
+         }
+         switch (in._sop) {
+            case CMD_SOP_ADD: x += y; break;
+            case CMD_SOP_SUB: x -= y; break;
+            case CMD_SOP_MUL: x *= y; break;
+            case CMD_SOP_DIV: x /= y; break;
+            case CMD_SOP_MOD: x %= y; break;
+            default: assert(0); break;
+         }
+         a = to_string(x);
+      }
+      else a = a + ' ' + sopStr[in._sop] + ' ' + b;
+   }
+   _values[in._var] = a;
+   _defined[in._var] = true;
+   return true;
+}
+
+// Evaluate the range or the items of the FOR loop
+bool
+CmdScript::startLoop(const CmdInstr& in, CmdLoop& loop)
+{
+   loop._items.clear();
+   loop._idx = 0;
+   if (in._sop == CMD_SOP_IN) {
+      loop._items.resize(in._args.size());
+      for (size_t i = 0, n = in._args.size(); i < n; ++i)
+         if (!render(in._args[i], loop._items[i])) return false;
+      return true;
+   }
+
+   string str[3];
+   int* num[3] = { &loop._cur, &loop._to, &loop._step };
+   loop._step = 1;
+   for (size_t i = 0, n = in._args.size(); i < n; ++i) {
+      if (!render(in._args[i], str[i])) return false;
+      if (!myStr2Int(str[i], *num[i])) {
+         cerr << "Error: \"" << str[i] << "\" is not an integer in \""
+              << (*_src)[in._line] << "\"!!" << endl;
+         return false;
+      }
+   }
+   if (loop._step == 0) {
+      cerr << "Error: zero step in \"" << (*_src)[in._line] << "\"!!"
+           << endl;
+      return false;
+   }
+   return true;
+}
+
+bool
+CmdScript::test(const CmdInstr& in, bool& res)
+{
+   string a, b;
+   int x, y;
+   if (!render(in._args[0], a)) return false;
+   if (in._sop == CMD_SOP_NONE) {
+      res = !a.empty() && !(myStr2Int(a, x) && x == 0);
+      return true;
+   }
+   if (!render(in._args[1], b)) return false;
+   int cmp = 0;
+   if (myStr2Int(a, x) && myStr2Int(b, y)) cmp = (x < y)? -1: (x > y);
+   else cmp = a.compare(b);
+   switch (in._sop) {
+      case CMD_SOP_EQ: res = (cmp == 0); break;
+      case CMD_SOP_NE: res = (cmp != 0); break;
+      case CMD_SOP_LT: res = (cmp < 0); break;
+      case CMD_SOP_LE: res = (cmp <= 0); break;
+      case CMD_SOP_GT: res = (cmp > 0); break;
+      case CMD_SOP_GE: res = (cmp >= 0); break;
+      default: assert(0); break;
+   }
+   return true;
+}
+
+bool
+CmdScript::render(const CmdText& text, string& res) const
+{
+   res = text._lits[0];
+   for (size_t i = 0, n = text._vars.size(); i < n; ++i) {
+      size_t slot = text._vars[i];
+      if (!_defined[slot]) {
+         cerr << "Error: variable \"" << _varNames[slot] << "\" is not set!!"
+              << endl;
+         return false;
+      }
+      res += _values[slot];
+      res += text._lits[i + 1];
+   }
+   return true;
+}
@@ -0,0 +1,146 @@
+/****************************************************************************
+  FileName     [ cmdScript.h ]
+  PackageName  [ cmd ]
+  Synopsis     [ Define script variables and control flow of command lines ]
+  Author       [ Chung-Yang (Ric) Huang ]
+  Copyright    [ Copyleft(c) 2007-present LaDs(III), GIEE, NTU, Taiwan ]
+****************************************************************************/
+#ifndef CMD_SCRIPT_H
+#define CMD_SCRIPT_H
+
+#include "cmdParser.h"
+
+//----------------------------------------------------------------------
+//    Script syntax
+//----------------------------------------------------------------------
+// SET <var> [<value>...]          value is "a op b" (op: + - * / %)
+//                                 evaluated if a and b are integers
+// FOR <var> <from> <to> [<step>]  ... END
+// FOR <var> IN <item>...          ... END
+// WHILE <cond>                    ... END
+// IF <cond>                       ... [ELSE ...] END
+//
+// <cond> is "<a>" (true if not empty and not 0) or "<a> <op> <b>" with
+// op: == != < <= > >= (compared as integers if both are integers).
+// "$var" or "${var}" in any line is replaced by the value of var; "$$"
+// is a '$'.
+//
+// A block is read up to its END, compiled once into a CmdProgram and then
+// run, so that the lines of a loop are not parsed again in each iteration.
+//
+
+//----------------------------------------------------------------------
+//    Class : CmdText
+//----------------------------------------------------------------------
+// Text with its variables resolved to slots of CmdScript. Its value is
+// _lits[0] + var(_vars[0]) + _lits[1] + ... + _lits.back()
+//
+struct CmdText
+{
+   vector<string>  _lits;
+   vector<size_t>  _vars;
+
+   bool isLiteral() const { return _vars.empty(); }
+};
+
+//----------------------------------------------------------------------
+//    Class : CmdInstr
+//----------------------------------------------------------------------
+enum CmdOpCode
+{
+   CMD_OP_EXEC  = 0,  // execute command _cmd, line _args[0] + _args[1]
+   CMD_OP_SET   = 1,  // _var = _args
+   CMD_OP_TEST  = 2,  // jump to _jump if the condition _args is false
+   CMD_OP_JUMP  = 3,  // jump to _jump
+   CMD_OP_FOR   = 4,  // start the loop over _args; jump to _jump if empty
+   CMD_OP_NEXT  = 5,  // next iteration of the loop started at _jump
+
+   // dummy
+   CMD_OP_TOT
+};
+
+enum CmdScriptOp
+{
+   CMD_SOP_NONE = 0,
+   CMD_SOP_EQ,  CMD_SOP_NE,  CMD_SOP_LT,  CMD_SOP_LE,  CMD_SOP_GT,  CMD_SOP_GE,
+   CMD_SOP_ADD, CMD_SOP_SUB, CMD_SOP_MUL, CMD_SOP_DIV, CMD_SOP_MOD,
+   CMD_SOP_IN,                       // FOR <var> IN ...
+
+   // dummy
+   CMD_SOP_TOT
+};
+
+struct CmdInstr
+{
+   CmdInstr(CmdOpCode op = CMD_OP_JUMP, size_t line = 0)
+   : _op(op), _sop(CMD_SOP_NONE), _cmd(0), _var(0), _jump(0), _line(line) {}
+
+   CmdOpCode         _op;
+   CmdScriptOp       _sop;           // SET, TEST: operator between _args;
+                                     // FOR: CMD_SOP_IN for a list
+   CmdExec*          _cmd;           // EXEC: 0 if not known when compiled
+   size_t            _var;           // SET, FOR: variable slot
+   size_t            _jump;          // target instruction
+   size_t            _line;          // source line, for error messages
+   vector<CmdText>   _args;
+};
+
+typedef vector<CmdInstr>  CmdProgram;
+
+//----------------------------------------------------------------------
+//    Class : CmdScript
+//----------------------------------------------------------------------
+// The variables of CmdParser, and the compiler and interpreter of the
+// script blocks.
+//
+class CmdScript
+{
+   struct CmdLoop                    // state of a running FOR loop
+   {
+      int             _cur;
+      int             _to;
+      int             _step;
+      vector<string>  _items;        // FOR ... IN
+      size_t          _idx;
+   };
+
+public:
+   CmdScript(CmdParser* p) : _parser(p), _src(0) {}
+   ~CmdScript() {}
+
+   static bool isScriptLine(const string& line);
+   static int blockDepth(const string& line);
+   CmdExecStatus exec(const string& line, istream* istr);
+   bool subst(const string& str, string& res);
+   // the defined variables, as kept by SAVEsession
+   void listVars(vector<pair<string, string> >& vars) const;
+   void assignVar(const string& name, const string& value);
+
+private:
+   bool readBlock(const string& first, istream* istr, vector<string>& lines);
+   bool compile(const vector<string>& lines, CmdProgram& prog);
+   bool compileBlock(const vector<string>&, size_t&, CmdProgram&);
+   bool compileSet(const string&, size_t, size_t, CmdProgram&);
+   bool compileFor(const string&, size_t, size_t, CmdProgram&);
+   bool compileCond(const string&, size_t, size_t, CmdProgram&);
+   bool compileExec(const string&, size_t, CmdProgram&);
+   bool compileText(const string&, CmdText&);
+   size_t getVar(const string& name);
+
+   CmdExecStatus run(const CmdProgram& prog, const vector<string>& lines);
+   CmdExecStatus execInstr(const CmdInstr& in);
+   bool setVar(const CmdInstr& in);
+   bool startLoop(const CmdInstr& in, CmdLoop& loop);
+   bool test(const CmdInstr& in, bool& res);
+   bool render(const CmdText& text, string& res) const;
+
+   CmdParser*            _parser;
+   const vector<string>* _src;       // lines of the program being compiled
+                                     // or run
+   map<string, size_t>   _varIdx;    // variable name -> slot
+   vector<string>        _varNames;
+   vector<string>        _values;
+   vector<bool>          _defined;
+};
+
+#endif // CMD_SCRIPT_H
@@ -0,0 +1,464 @@
+/****************************************************************************
+  FileName     [ cmdSession.cpp ]
+  PackageName  [ cmd ]
+  Synopsis     [ Define the session file and CmdParser::saveSession() ]
+  Author       [ Chung-Yang (Ric) Huang ]
+  Copyright    [ Copyleft(c) 2007-present LaDs(III), GIEE, NTU, Taiwan ]
+****************************************************************************/
+#include <cstdio>
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "cmdSession.h"
+#include "cmdScript.h"
+#include "cmdDofile.h"
+#include "cmdPkg.h"
+
+using namespace std;
+
+//----------------------------------------------------------------------
+//    Global static funcitons
+//----------------------------------------------------------------------
+static size_t
+alignUp(size_t n)
+{
+   return (n + SESSION_ALIGN - 1) / SESSION_ALIGN * SESSION_ALIGN;
+}
+
+static void
+corrupted(const string& file)
+{
+   cerr << "Error: session file \"" << file << "\" is corrupted!!" << endl;
+}
+
+
+//----------------------------------------------------------------------
+//    Member Function for class CmdSessionWriter
+//----------------------------------------------------------------------
+bool
+CmdSessionWriter::add(const string& name, const string& data)
+{
+   if (name.size() >= sizeof(((CmdSessionSection*)0)->_name)) return false;
+   _sections.push_back(make_pair(name, data));
+   return true;
+}
+
+// Written to "file.tmp" first and renamed to "file", so that an existing
+// session is not lost to a failed write
+bool
+CmdSessionWriter::write(const string& file) const
+{
+   size_t n = _sections.size();
+   CmdSessionHeader header;
+   memset(&header, 0, sizeof(header));
+   memcpy(header._magic, SESSION_MAGIC, sizeof(header._magic));
+   header._version = SESSION_VERSION;
+   header._nSections = n;
+
+   vector<CmdSessionSection> table(n);
+   size_t offset = alignUp(sizeof(header) + n * sizeof(CmdSessionSection));
+   for (size_t i = 0; i < n; ++i) {
+      memset(&table[i], 0, sizeof(CmdSessionSection));
+      strcpy(table[i]._name, _sections[i].first.c_str());
+      table[i]._offset = offset;
+      table[i]._size = _sections[i].second.size();
+      offset = alignUp(offset + table[i]._size);
+   }
+   header._size = offset;
+
+   string tmp = file + ".tmp";
+   ofstream ofs(tmp.c_str(), ios::binary | ios::trunc);
+   if (ofs) {
+      const char pad[SESSION_ALIGN] = { 0 };
+      size_t pos = sizeof(header) + n * sizeof(CmdSessionSection);
+      ofs.write((const char*)&header, sizeof(header));
+      if (n != 0)
+         ofs.write((const char*)&table[0], n * sizeof(CmdSessionSection));
+      for (size_t i = 0; i < n; ++i) {
+         ofs.write(pad, table[i]._offset - pos);
+         ofs.write(_sections[i].second.data(), table[i]._size);
+         pos = table[i]._offset + table[i]._size;
+      }
+      ofs.write(pad, offset - pos);
+      ofs.close();
+   }
+   if (!ofs || rename(tmp.c_str(), file.c_str()) != 0) {
+      unlink(tmp.c_str());
+      cerr << "Error: cannot write file \"" << file << "\"!!" << endl;
+      return false;
+   }
+   return true;
+}
+
+// In native byte order, as the file is read in place
+void
+CmdSessionWriter::put(string& data, uint32_t n)
+{
+   data.append((const char*)&n, sizeof(n));
+}
+
+void
+CmdSessionWriter::put(string& data, uint64_t n)
+{
+   data.append((const char*)&n, sizeof(n));
+}
+
+void
+CmdSessionWriter::put(string& data, const string& str)
+{
+   put(data, uint32_t(str.size()));
+   data.append(str);
+}
+
+
+//----------------------------------------------------------------------
+//    Member Function for class CmdSessionReader
+//----------------------------------------------------------------------
+bool
+CmdSessionReader::open(const string& file)
+{
+   close();
+   int fd = ::open(file.c_str(), O_RDONLY | O_CLOEXEC);
+   if (fd < 0) {
+      cerr << "Error: cannot open file \"" << file << "\"!!" << endl;
+      return false;
+   }
+   struct stat st;
+   void* map = MAP_FAILED;
+   if (fstat(fd, &st) == 0 && size_t(st.st_size) >= sizeof(CmdSessionHeader))
+      map = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+   ::close(fd);
+   if (map == MAP_FAILED) {
+      cerr << "Error: \"" << file << "\" is not a session file!!" << endl;
+      return false;
+   }
+   _map = (const char*)map;
+   _size = st.st_size;
+
+   CmdSessionHeader header;
+   memcpy(&header, _map, sizeof(header));
+   if (memcmp(header._magic, SESSION_MAGIC, sizeof(header._magic)) != 0) {
+      close();
+      cerr << "Error: \"" << file << "\" is not a session file!!" << endl;
+      return false;
+   }
+   if (header._version == 0 || header._version > SESSION_VERSION) {
+      close();
+      cerr << "Error: session file \"" << file << "\" is of version "
+           << header._version << ", not supported!!" << endl;
+      return false;
+   }
+   // Check the table once, so that find() can trust it
+   size_t tableEnd = sizeof(header);
+   bool ok = header._size == _size && header._nSections <=
+                (_size - tableEnd) / sizeof(CmdSessionSection);
+   if (ok) tableEnd += header._nSections * sizeof(CmdSessionSection);
+   for (size_t i = 0; ok && i < header._nSections; ++i) {
+      const CmdSessionSection* s = section(i);
+      ok = s->_name[sizeof(s->_name) - 1] == 0 && s->_offset >= tableEnd &&
+           s->_offset <= _size && s->_size <= _size - s->_offset;
+   }
+   if (!ok) {
+      close();
+      corrupted(file);
+      return false;
+   }
+   return true;
+}
+
+void
+CmdSessionReader::close()
+{
+   if (_map != 0) munmap((void*)_map, _size);
+   _map = 0;
+   _size = 0;
+}
+
+bool
+CmdSessionReader::find(const string& name, const char*& data, size_t& size)
+   const
+{
+   for (size_t i = 0, n = numSections(); i < n; ++i) {
+      const CmdSessionSection* s = section(i);
+      if (name == s->_name) {
+         data = _map + s->_offset;
+         size = s->_size;
+         return true;
+      }
+   }
+   return false;
+}
+
+size_t
+CmdSessionReader::numSections() const
+{
+   if (_map == 0) return 0;
+   uint32_t n;
+   memcpy(&n, _map + offsetof(CmdSessionHeader, _nSections), sizeof(n));
+   return n;
+}
+
+string
+CmdSessionReader::getName(size_t i) const
+{
+   return section(i)->_name;
+}
+
+bool
+CmdSessionReader::get(const char*& p, const char* end, uint32_t& n)
+{
+   if (size_t(end - p) < sizeof(n)) return false;
+   memcpy(&n, p, sizeof(n));
+   p += sizeof(n);
+   return true;
+}
+
+bool
+CmdSessionReader::get(const char*& p, const char* end, uint64_t& n)
+{
+   if (size_t(end - p) < sizeof(n)) return false;
+   memcpy(&n, p, sizeof(n));
+   p += sizeof(n);
+   return true;
+}
+
+bool
+CmdSessionReader::get(const char*& p, const char* end, string& str)
+{
+   uint32_t n;
+   if (!get(p, end, n) || size_t(end - p) < n) return false;
+   str.assign(p, n);
+   p += n;
+   return true;
+}
+
+// The table follows the header, aligned for its uint64's
+const CmdSessionSection*
+CmdSessionReader::section(size_t i) const
+{
+   return (const CmdSessionSection*)(_map + sizeof(CmdSessionHeader)) + i;
+}
+
+
+//----------------------------------------------------------------------
+//    Member Function for class CmdParser
+//----------------------------------------------------------------------
+// "s" is not owned; it must outlive the parser or the package
+bool
+CmdParser::regSnapshot(const string& pkg, CmdSnapshot* s)
+{
+   lock_guard<recursive_mutex> lock(_pkgMutex);
+   if (s == 0 || _snapshots.find(pkg) != _snapshots.end()) return false;
+   _snapshots[pkg] = s;
+   return true;
+}
+
+bool
+CmdParser::saveSession(const string& file) const
+{
+   typedef CmdSessionWriter W;
+   W writer;
+   string data;
+
+   size_t nHistory = _history.size() - (_tempCmdStored? 1: 0);
+   W::put(data, uint32_t(nHistory));
+   for (size_t i = 0; i < nHistory; ++i)
+      W::put(data, _history[i]);
+   writer.add("history", data);
+
+   vector<pair<string, string> > vars;
+   if (_script != 0) _script->listVars(vars);
+   data.clear();
+   W::put(data, uint32_t(vars.size()));
+   for (size_t i = 0, n = vars.size(); i < n; ++i) {
+      W::put(data, vars[i].first);
+      W::put(data, vars[i].second);
+   }
+   writer.add("vars", data);
+
+   // By the full name of the command, as the CmdExec's are not kept
+   vector<pair<string, unsigned> > budgets;
+   for (map<const CmdExec*, unsigned>::const_iterator it = _budgets.begin();
+        it != _budgets.end(); ++it) {
+      string name = getCmdName(it->first);
+      if (name.size()) budgets.push_back(make_pair(name, it->second));
+   }
+   data.clear();
+   W::put(data, _budget);
+   W::put(data, uint32_t(budgets.size()));
+   for (size_t i = 0, n = budgets.size(); i < n; ++i) {
+      W::put(data, budgets[i].first);
+      W::put(data, budgets[i].second);
+   }
+   writer.add("budgets", data);
+
+   {
+      lock_guard<recursive_mutex> lock(_pkgMutex);
+      vector<string> pkgs;
+      for (size_t i = 0, n = _pkgs.size(); i < n; ++i)
+         if (_pkgs[i]->_loaded) pkgs.push_back(_pkgs[i]->_name);
+      data.clear();
+      W::put(data, uint32_t(pkgs.size()));
+      for (size_t i = 0, n = pkgs.size(); i < n; ++i)
+         W::put(data, pkgs[i]);
+      writer.add("pkgs", data);
+
+      for (map<string, CmdSnapshot*>::const_iterator it = _snapshots.begin();
+           it != _snapshots.end(); ++it) {
+         data.clear();
+         if (!it->second->save(data) || !writer.add("pkg." + it->first, data)) {
+            cerr << "Error: cannot save the state of package \""
+                 << it->first << "\"!!" << endl;
+            return false;
+         }
+      }
+   }
+
+   // _dofilePosStack has the outer dofiles, innermost on top, and the
+   // prompt ("") at the bottom
+   vector<pair<string, size_t> > dofiles;
+   if (_dofile != 0) dofiles.push_back(make_pair(_dofileName, _dofileLine));
+   stack<pair<string, size_t> > pos = _dofilePosStack;
+   for (; !pos.empty(); pos.pop())
+      if (pos.top().first.size()) dofiles.push_back(pos.top());
+   data.clear();
+   W::put(data, uint32_t(dofiles.size()));
+   for (size_t i = dofiles.size(); i-- > 0; ) {
+      W::put(data, dofiles[i].first);
+      W::put(data, uint32_t(dofiles[i].second));
+   }
+   writer.add("dofiles", data);
+
+   return writer.write(file);
+}
+
+// The sections are all parsed before any is applied, so that a corrupted
+// file changes nothing but the packages it loads
+bool
+CmdParser::loadSession(const string& file)
+{
+   typedef CmdSessionReader R;
+   R reader;
+   if (!reader.open(file)) return false;
+
+   bool ok = true, parsed = true;
+   const char *p, *end;
+   size_t size;
+   uint32_t n;
+
+   // Packages first, for their commands and snapshots
+   if (reader.find("pkgs", p, size)) {
+      end = p + size;
+      parsed = R::get(p, end, n);
+      for (uint32_t i = 0; parsed && i < n; ++i) {
+         string name;
+         if (!(parsed = R::get(p, end, name))) break;
+         if (!loadPkg(name)) ok = false;
+      }
+   }
+
+   vector<string> history;
+   if (parsed && reader.find("history", p, size)) {
+      end = p + size;
+      parsed = R::get(p, end, n);
+      history.resize(parsed? n: 0);
+      for (uint32_t i = 0; parsed && i < n; ++i)
+         parsed = R::get(p, end, history[i]);
+   }
+
+   vector<pair<string, string> > vars;
+   if (parsed && reader.find("vars", p, size)) {
+      end = p + size;
+      parsed = R::get(p, end, n);
+      vars.resize(parsed? n: 0);
+      for (uint32_t i = 0; parsed && i < n; ++i)
+         parsed = R::get(p, end, vars[i].first) &&
+                  R::get(p, end, vars[i].second);
+   }
+
+   uint32_t budget = _budget;
+   vector<pair<string, uint32_t> > budgets;
+   if (parsed && reader.find("budgets", p, size)) {
+      end = p + size;
+      parsed = R::get(p, end, budget) && R::get(p, end, n);
+      budgets.resize(parsed? n: 0);
+      for (uint32_t i = 0; parsed && i < n; ++i)
+         parsed = R::get(p, end, budgets[i].first) &&
+                  R::get(p, end, budgets[i].second);
+   }
+
+   vector<pair<string, uint32_t> > dofiles;
+   if (parsed && reader.find("dofiles", p, size)) {
+      end = p + size;
+      parsed = R::get(p, end, n);
+      dofiles.resize(parsed? n: 0);
+      for (uint32_t i = 0; parsed && i < n; ++i)
+         parsed = R::get(p, end, dofiles[i].first) &&
+                  R::get(p, end, dofiles[i].second);
+   }
+
+   if (!parsed) {
+      corrupted(file);
+      return false;
+   }
+
+   // Before the history of this session
+   if (_tempCmdStored) {
+      _history.pop_back();
+      _tempCmdStored = false;
+   }
+   _history.insert(_history.begin(), history.begin(), history.end());
+   _historyIdx = _history.size();
+
+   for (size_t i = 0, m = vars.size(); i < m; ++i)
+      getScript()->assignVar(vars[i].first, vars[i].second);
+
+   setBudget(budget);
+   for (size_t i = 0, m = budgets.size(); i < m; ++i) {
+      CmdExec* e = getCmd(budgets[i].first);
+      if (e == 0) {
+         cerr << "Error: unknown command \"" << budgets[i].first
+              << "\" in the budgets!!" << endl;
+         ok = false;
+      }
+      else setBudget(budgets[i].second, e);
+   }
+
+   for (size_t i = 0, m = reader.numSections(); i < m; ++i) {
+      string name = reader.getName(i);
+      if (name.compare(0, 4, "pkg.") != 0) continue;
+      string pkg = name.substr(4);
+      reader.find(name, p, size);
+      map<string, CmdSnapshot*>::iterator it = _snapshots.find(pkg);
+      if (it == _snapshots.end() || !it->second->load(p, size)) {
+         cerr << "Error: cannot restore the state of package \"" << pkg
+              << "\"!!" << endl;
+         ok = false;
+      }
+   }
+
+   // Resumed after the lines they had read, but only from the prompt; a
+   // dofile loading a session goes on with its own lines
+   if (_dofile == 0) {
+      for (size_t i = 0, m = dofiles.size(); i < m; ++i) {
+         const string& name = dofiles[i].first;
+         istream* dofile = 0;
+         if (_dofileStack.size() + 1 < DOFILE_MAX_DEPTH)
+            dofile = getDofileCache()->open(name);
+         if (dofile == 0) {
+            cerr << "Error: cannot open file \"" << name << "\"!!" << endl;
+            ok = false;
+            break;
+         }
+         string line;
+         for (size_t k = 0; k < dofiles[i].second && getline(*dofile, line); )
+            ++k;
+         pushDofile(dofile, name, dofiles[i].second);
+      }
+   }
+   return ok;
+}
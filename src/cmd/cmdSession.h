@@ -0,0 +1,111 @@
+/****************************************************************************
+  FileName     [ cmdSession.h ]
+  PackageName  [ cmd ]
+  Synopsis     [ Define the session file of SAVEsession and LOADsession ]
+  Author       [ Chung-Yang (Ric) Huang ]
+  Copyright    [ Copyleft(c) 2007-present LaDs(III), GIEE, NTU, Taiwan ]
+****************************************************************************/
+#ifndef CMD_SESSION_H
+#define CMD_SESSION_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "cmdParser.h"
+
+using namespace std;
+
+//----------------------------------------------------------------------
+//    Session file layout
+//----------------------------------------------------------------------
+// A header, a table of named sections, and the data of the sections,
+// each at an offset aligned to 8 bytes. The file is mapped and read in
+// place; a CmdSnapshot gets its section as it is in the mapping.
+//
+//    history    <n> <line>...              oldest first
+//    vars       <n> (<name> <value>)...    defined script variables
+//    budgets    <ms> <n> (<cmd> <ms>)...   default and per command
+//    pkgs       <n> <pkg>...               loaded packages
+//    dofiles    <n> (<file> <line>)...     outermost first; lines read
+//    pkg.<name> what the CmdSnapshot of <name> saved; "pkg.cmd" has the
+//               limits of the cache (see CmdCacheSnapshot)
+//
+// <n>, <ms> and <line> are uint32; a string is a uint32 length and its
+// bytes. A reader skips the sections it does not know, and rejects files
+// of a later version.
+//
+#define SESSION_MAGIC     "DSNPSESS"
+#define SESSION_VERSION   1
+#define SESSION_ALIGN     8
+
+struct CmdSessionHeader
+{
+   char      _magic[8];
+   uint32_t  _version;
+   uint32_t  _nSections;
+   uint64_t  _size;                  // of the file
+};
+
+struct CmdSessionSection
+{
+   char      _name[48];              // 0-terminated
+   uint64_t  _offset;
+   uint64_t  _size;
+};
+
+//----------------------------------------------------------------------
+//    Class : CmdSessionWriter
+//----------------------------------------------------------------------
+class CmdSessionWriter
+{
+public:
+   CmdSessionWriter() {}
+   ~CmdSessionWriter() {}
+
+   // "data" is built with put()
+   bool add(const string& name, const string& data);
+   // To "file" as a whole or not at all
+   bool write(const string& file) const;
+
+   static void put(string& data, uint32_t n);
+   static void put(string& data, uint64_t n);
+   static void put(string& data, const string& str);
+
+private:
+   vector<pair<string, string> >  _sections;
+};
+
+//----------------------------------------------------------------------
+//    Class : CmdSessionReader
+//----------------------------------------------------------------------
+class CmdSessionReader
+{
+public:
+   CmdSessionReader() : _map(0), _size(0) {}
+   ~CmdSessionReader() { close(); }
+
+   // Print why if it is not a valid session file
+   bool open(const string& file);
+   void close();
+
+   // Return false if there is no section "name"
+   bool find(const string& name, const char*& data, size_t& size) const;
+   size_t numSections() const;
+   string getName(size_t i) const;
+
+   // Read from "p" (up to "end") and advance it; false if truncated
+   static bool get(const char*& p, const char* end, uint32_t& n);
+   static bool get(const char*& p, const char* end, uint64_t& n);
+   static bool get(const char*& p, const char* end, string& str);
+
+private:
+   CmdSessionReader(const CmdSessionReader&);
+   CmdSessionReader& operator = (const CmdSessionReader&);
+
+   const CmdSessionSection* section(size_t i) const;
+
+   const char*  _map;
+   size_t       _size;
+};
+
+#endif // CMD_SESSION_H
@@ -0,0 +1,299 @@
+/****************************************************************************
+  FileName     [ cmdTask.cpp ]
+  PackageName  [ cmd ]
+  Synopsis     [ Define interleaved dofile tasks and their waits ]
+  Author       [ Chung-Yang (Ric) Huang ]
+  Copyright    [ Copyleft(c) 2007-present LaDs(III), GIEE, NTU, Taiwan ]
+****************************************************************************/
+#include <iomanip>
+#include <cerrno>
+#include <poll.h>
+#include <sys/mman.h>
+#include "myEvent.h"
+#include "cmdTask.h"
+
+using namespace std;
+
+//----------------------------------------------------------------------
+//    Global static variables and funcitons
+//----------------------------------------------------------------------
+typedef chrono::steady_clock::time_point  TimePoint;
+
+static CmdTask* curTask = 0;         // the task being resumed
+
+// Milliseconds from now to "t" for poll(), rounded up; -1 for no limit
+static int
+pollMs(const TimePoint& t)
+{
+   if (t == TimePoint::max()) return -1;
+   long long us = chrono::duration_cast<chrono::microseconds>
+                     (t - chrono::steady_clock::now()).count();
+   if (us <= 0) return 0;
+   return int(min((us + 999) / 1000, 1LL << 30));
+}
+
+
+//----------------------------------------------------------------------
+//    Global functions
+//----------------------------------------------------------------------
+bool
+cmdInTask()
+{
+   return curTask != 0;
+}
+
+bool
+cmdAwaitFd(int fd, short events, int ms)
+{
+   TimePoint until = (ms < 0)? TimePoint::max():
+                     chrono::steady_clock::now() + chrono::milliseconds(ms);
+   if (curTask) return curTask->wait(fd, events, until);
+
+   // Signals are not restarted by poll(); see if it is one of ours. On
+   // the main thread, the events of myEventLoop() are served meanwhile.
+   EventLoop& loop = myEventLoop();
+   bool inLoop = loop.isOpen() && loop.isLoopThread();
+   struct pollfd pfd = { fd, events, 0 };
+   while (true) {
+      int n = inLoop? loop.waitFd(fd, events, pollMs(until)):
+                      poll(&pfd, 1, pollMs(until));
+      if (cmdInterrupted()) return false;
+      if (n > 0) return true;
+      if (n == 0 || (!inLoop && errno != EINTR)) return false;
+   }
+}
+
+bool
+cmdAwaitUntil(const TimePoint& t)
+{
+   if (curTask) return curTask->wait(-1, 0, t);
+   EventLoop& loop = myEventLoop();
+   bool inLoop = loop.isOpen() && loop.isLoopThread();
+   while (!cmdInterrupted()) {
+      int ms = pollMs(t);
+      if (ms == 0) return true;
+      if (inLoop) loop.waitFd(-1, 0, ms);
+      else poll(0, 0, ms);
+   }
+   return false;
+}
+
+
+//----------------------------------------------------------------------
+//    Member Function for class CmdTask
+//----------------------------------------------------------------------
+CmdTask::CmdTask(const string& file)
+: _file(file), _stack(0), _done(false), _status(CMD_EXEC_DONE), _lines(0),
+  _errors(0), _ms(0), _waiting(false), _fd(-1), _events(0), _revents(0),
+  _until(TimePoint::max()), _cancelled(false), _dofile(0), _dofileLine(0),
+  _coutBuf(_out.rdbuf()), _cerrBuf(_err.rdbuf()), _allocStats(0),
+  _allocLive(0)
+{
+   // The lowest page is a guard against overflows
+   void* p = mmap(0, TASK_STACK_SIZE, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+   if (p == MAP_FAILED) return;
+   _stack = (char*)p;
+   mprotect(_stack, 4096, PROT_NONE);
+
+   getcontext(&_ctx);
+   _ctx.uc_stack.ss_sp = _stack;
+   _ctx.uc_stack.ss_size = TASK_STACK_SIZE;
+   _ctx.uc_link = &_caller;
+   makecontext(&_ctx, entry, 0);
+}
+
+CmdTask::~CmdTask()
+{
+   if (_stack) munmap(_stack, TASK_STACK_SIZE);
+}
+
+// Return the task being resumed, or 0 outside of the tasks
+const CmdTask*
+CmdTask::current()
+{
+   return curTask;
+}
+
+// Suspend until "fd" has any of "events" (if "fd" >= 0) or "until".
+// Return false if it timed out or is cancelled.
+bool
+CmdTask::wait(int fd, short events, const TimePoint& until)
+{
+   _waiting = true;
+   _fd = fd;
+   _events = events;
+   _revents = 0;
+   _until = until;
+   swapcontext(&_ctx, &_caller);
+   _waiting = false;
+   if (_cancelled || cmdInterrupted()) return false;
+   return (fd < 0)? true: _revents != 0;
+}
+
+void
+CmdTask::entry()
+{
+   curTask->run();
+   curTask->_done = true;
+}
+
+// Execute the dofile like main() does, up to its end or Quit, which ends
+// the task only
+void
+CmdTask::run()
+{
+   if (!cmdMgr->openDofile(_file)) {
+      cerr << "Error: cannot open file \"" << _file << "\"!!" << endl;
+      _status = CMD_EXEC_ERROR;
+      return;
+   }
+   while (cmdMgr->inDofile()) {
+      CmdExecStatus status = cmdMgr->execOneCmd();
+      cout << endl;
+      if (status == CMD_EXEC_NOP) continue;
+      ++_lines;
+      if (status == CMD_EXEC_ERROR) {
+         ++_errors;
+         _status = status;
+      }
+      else if (status == CMD_EXEC_QUIT || status == CMD_EXEC_INTERRUPTED) {
+         _status = status;
+         while (cmdMgr->inDofile()) cmdMgr->closeDofile();
+      }
+   }
+}
+
+bool
+CmdTask::isReady(const TimePoint& now) const
+{
+   return !_waiting || _cancelled || _revents != 0 || now >= _until;
+}
+
+//----------------------------------------------------------------------
+//    Member Function for class CmdScheduler
+//----------------------------------------------------------------------
+CmdScheduler::~CmdScheduler()
+{
+   for (size_t i = 0, n = _tasks.size(); i < n; ++i)
+      delete _tasks[i];
+}
+
+// Run the tasks to their ends, each printing its output as it ends.
+// Return CMD_EXEC_INTERRUPTED if cancelled, with cmdCancel set to why,
+// or CMD_EXEC_ERROR if any line of any task fails.
+CmdExecStatus
+CmdScheduler::run()
+{
+   int reason = CMD_CANCEL_NONE;
+   size_t nFinished = 0;
+   for (size_t i = 0, n = _tasks.size(); i < n; ++i)
+      if (_tasks[i]->_stack == 0) {
+         cerr << "Error: cannot allocate the stack of \""
+              << _tasks[i]->_file << "\"!!" << endl;
+         return CMD_EXEC_ERROR;
+      }
+
+   while (nFinished < _tasks.size()) {
+      bool resumed = false;
+      for (size_t i = 0, n = _tasks.size(); i < n; ++i) {
+         CmdTask* t = _tasks[i];
+         if (t->_done) continue;
+         if (reason == CMD_CANCEL_NONE && cmdInterrupted())
+            reason = cmdCancel.load();
+         if (reason != CMD_CANCEL_NONE) {
+            t->_cancelled = true;
+            cmdCancel.store(reason);
+         }
+         if (!t->isReady(chrono::steady_clock::now())) continue;
+         resume(t);
+         resumed = true;
+         if (t->_status == CMD_EXEC_INTERRUPTED && reason == CMD_CANCEL_NONE)
+            reason = cmdMgr->_lastCancel;
+         if (t->_done) {
+            finish(t, i);
+            ++nFinished;
+         }
+      }
+      if (!resumed && nFinished < _tasks.size()) waitReady();
+   }
+
+   if (reason != CMD_CANCEL_NONE) {
+      cmdCancel.store(reason);
+      return CMD_EXEC_INTERRUPTED;
+   }
+   for (size_t i = 0, n = _tasks.size(); i < n; ++i)
+      if (_tasks[i]->_status != CMD_EXEC_DONE &&
+          _tasks[i]->_status != CMD_EXEC_QUIT)
+         return CMD_EXEC_ERROR;
+   return CMD_EXEC_DONE;
+}
+
+void
+CmdScheduler::resume(CmdTask* t)
+{
+   TimePoint start = chrono::steady_clock::now();
+   swapState(t);
+   curTask = t;
+   swapcontext(&t->_caller, &t->_ctx);
+   curTask = 0;
+   swapState(t);
+   t->_ms += chrono::duration<double, milli>
+                (chrono::steady_clock::now() - start).count();
+}
+
+// Exchange the state of task "t" with that of the parser, the streams
+// and the thread; it is its own inverse
+void
+CmdScheduler::swapState(CmdTask* t)
+{
+   CmdParser* p = cmdMgr;
+   swap(t->_dofile, p->_dofile);
+   swap(t->_dofileName, p->_dofileName);
+   swap(t->_dofileLine, p->_dofileLine);
+   swap(t->_dofileStack, p->_dofileStack);
+   swap(t->_dofilePosStack, p->_dofilePosStack);
+   t->_coutBuf = cout.rdbuf(t->_coutBuf);
+   t->_cerrBuf = cerr.rdbuf(t->_cerrBuf);
+   swapAllocScope(t->_allocStats, t->_allocLive);
+}
+
+// Sleep until a task is ready to be resumed, or a signal
+void
+CmdScheduler::waitReady()
+{
+   vector<struct pollfd> fds;
+   vector<CmdTask*> tasks;
+   TimePoint until = TimePoint::max();
+   for (size_t i = 0, n = _tasks.size(); i < n; ++i) {
+      CmdTask* t = _tasks[i];
+      if (t->_done) continue;
+      if (t->_fd >= 0) {
+         struct pollfd pfd = { t->_fd, t->_events, 0 };
+         fds.push_back(pfd);
+         tasks.push_back(t);
+      }
+      until = min(until, t->_until);
+   }
+   if (poll(fds.data(), fds.size(), pollMs(until)) <= 0) return;
+   for (size_t i = 0, n = fds.size(); i < n; ++i)
+      tasks[i]->_revents = fds[i].revents;
+}
+
+// Print the output of the "i"th task, which has ended
+void
+CmdScheduler::finish(CmdTask* t, size_t i)
+{
+   ios_base::fmtflags flags = cout.flags();
+   streamsize prec = cout.precision();
+   cout << "[" << i + 1 << "] " << t->_file << ": " << t->_lines
+        << " lines, " << t->_errors << " errors, " << fixed
+        << setprecision(3) << t->_ms << " ms" << endl;
+   cout.flags(flags);
+   cout.precision(prec);
+   cout << t->_out.str();
+   cout.flush();
+   cerr << t->_err.str();
+   t->_out.str("");
+   t->_err.str("");
+}
@@ -0,0 +1,111 @@
+/****************************************************************************
+  FileName     [ cmdTask.h ]
+  PackageName  [ cmd ]
+  Synopsis     [ Define classes CmdTask and CmdScheduler for DOInterleave ]
+  Author       [ Chung-Yang (Ric) Huang ]
+  Copyright    [ Copyleft(c) 2007-present LaDs(III), GIEE, NTU, Taiwan ]
+****************************************************************************/
+#ifndef CMD_TASK_H
+#define CMD_TASK_H
+
+#include <string>
+#include <vector>
+#include <sstream>
+#include <chrono>
+#include <ucontext.h>
+#include "cmdParser.h"
+
+using namespace std;
+
+//----------------------------------------------------------------------
+//    Class : CmdTask
+//----------------------------------------------------------------------
+// A dofile executed as a coroutine on a stack of its own. It suspends
+// when one of its commands waits in cmdAwaitFd() or cmdAwaitUntil(), and
+// is resumed by CmdScheduler when the wait is over, so that the tasks
+// interleave on one thread without any lock.
+//
+// Each task has its own stack of dofiles, cout and cerr (buffered until
+// it ends), and allocation scope; the history, script variables and
+// commands are shared.
+//
+class CmdTask
+{
+#define TASK_STACK_SIZE  (1 << 20)   // reserved; touched pages only
+
+   friend class CmdScheduler;
+   typedef chrono::steady_clock::time_point  TimePoint;
+
+public:
+   CmdTask(const string& file);
+   ~CmdTask();
+
+   static const CmdTask* current();
+   bool wait(int fd, short events, const TimePoint& until);
+
+private:
+   static void entry();
+   void run();
+   bool isReady(const TimePoint& now) const;
+
+   string            _file;
+   char*             _stack;
+   ucontext_t        _ctx;           // of the task
+   ucontext_t        _caller;        // of the scheduler, while resumed
+   bool              _done;
+   CmdExecStatus     _status;        // INTERRUPTED, QUIT or ERROR if any
+   size_t            _lines;
+   size_t            _errors;
+   double            _ms;            // resumed in total
+
+   // The wait it is suspended in
+   bool              _waiting;
+   int               _fd;            // -1: no fd
+   short             _events;
+   short             _revents;
+   TimePoint         _until;         // TimePoint::max(): no timeout
+   bool              _cancelled;
+
+   // Swapped with those of CmdParser, cout, cerr and the thread while it
+   // is resumed
+   istream*                       _dofile;
+   string                         _dofileName;
+   size_t                         _dofileLine;
+   stack<istream*>                _dofileStack;
+   stack<pair<string, size_t> >   _dofilePosStack;
+   ostringstream                  _out;
+   ostringstream                  _err;
+   streambuf*                     _coutBuf;
+   streambuf*                     _cerrBuf;
+   AllocStats*                    _allocStats;
+   long long                      _allocLive;
+};
+
+//----------------------------------------------------------------------
+//    Class : CmdScheduler
+//----------------------------------------------------------------------
+// Resumes the ready tasks in turn; when none is ready, poll()s the fds
+// they wait for until one is, or the earliest timeout. Once cancelled,
+// each task is resumed with cmdCancel set, so that it stops.
+//
+class CmdScheduler
+{
+   typedef chrono::steady_clock::time_point  TimePoint;
+
+public:
+   CmdScheduler() {}
+   ~CmdScheduler();
+
+   void add(const string& file) { _tasks.push_back(new CmdTask(file)); }
+   CmdExecStatus run();
+
+private:
+   void resume(CmdTask* t);
+   void swapState(CmdTask* t);
+   void waitReady();
+   void finish(CmdTask* t, size_t i);
+
+   vector<CmdTask*>  _tasks;
+};
+
+#endif // CMD_TASK_H
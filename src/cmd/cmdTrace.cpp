@@ -0,0 +1,175 @@
+/****************************************************************************
+  FileName     [ cmdTrace.cpp ]
+  PackageName  [ cmd ]
+  Synopsis     [ Define member functions for class CmdTracer ]
+  Author       [ Chung-Yang (Ric) Huang ]
+  Copyright    [ Copyleft(c) 2007-present LaDs(III), GIEE, NTU, Taiwan ]
+****************************************************************************/
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <cstdio>
+#include <unistd.h>
+#include "util.h"
+#include "cmdParser.h"
+#include "cmdTrace.h"
+
+using namespace std;
+
+//----------------------------------------------------------------------
+//    Global variable
+//----------------------------------------------------------------------
+CmdTracer cmdTracer;
+
+//----------------------------------------------------------------------
+//    Global static funcitons
+//----------------------------------------------------------------------
+static string
+jsonStr(const string& str)
+{
+   string res = "\"";
+   for (size_t i = 0, n = str.size(); i < n; ++i) {
+      unsigned char ch = str[i];
+      if (ch == '"' || ch == '\\') { res += '\\'; res += ch; }
+      else if (ch < 0x20) {
+         char buf[8];
+         sprintf(buf, "\\u%04x", ch);
+         res += buf;
+      }
+      else res += ch;
+   }
+   return res + "\"";
+}
+
+
+//----------------------------------------------------------------------
+//    Member Function for class CmdParser
+//----------------------------------------------------------------------
+// Name "span" after the command in _history.back(), and add where it
+// was read from
+void
+CmdParser::traceCmd(CmdTraceSpan& span) const
+{
+   const string& line = _history.back();
+   string cmd;
+   size_t n = myStrGetTok(line, cmd);
+   span.setName(cmd);
+   span.addArg("options", (n == string::npos)? "": line.substr(n + 1));
+   span.addArg("dofile", _dofile? _dofileName: "");
+   span.addArg("line", _dofile? _dofileLine: 0);
+   span.addArg("depth", _dofileStack.size());
+}
+
+
+//----------------------------------------------------------------------
+//    Member Function for class CmdTracer
+//----------------------------------------------------------------------
+CmdTracer::~CmdTracer()
+{
+   stop();
+   for (size_t i = 0, n = _bufs.size(); i < n; ++i)
+      delete _bufs[i];
+}
+
+// Start tracing to "file"; a trace in progress is written first.
+// Return false if "file" cannot be written.
+bool
+CmdTracer::start(const string& file)
+{
+   stop();
+   ofstream ofs(file.c_str());
+   if (!ofs) return false;
+   _file = file;
+   _start = chrono::steady_clock::now();
+   _on.store(true, memory_order_relaxed);
+   return true;
+}
+
+// Write the recorded spans to the file and clear them.
+// Return false if it is not tracing or the file cannot be written.
+bool
+CmdTracer::stop()
+{
+   if (!isOn()) return false;
+   _on.store(false, memory_order_relaxed);
+
+   lock_guard<mutex> lock(_mutex);
+   ofstream ofs(_file.c_str());
+   ofs << fixed << setprecision(3) << "{\"traceEvents\":[";
+   bool first = true;
+   for (size_t i = 0, n = _bufs.size(); i < n; ++i) {
+      vector<CmdTraceEvent>& events = _bufs[i]->_events;
+      for (size_t j = 0, m = events.size(); j < m; ++j) {
+         const CmdTraceEvent& e = events[j];
+         ofs << (first? "\n": ",\n") << "{\"name\":" << jsonStr(e._name)
+             << ",\"cat\":\"cmd\",\"ph\":\"X\",\"ts\":" << e._ts
+             << ",\"dur\":" << e._dur << ",\"pid\":" << getpid()
+             << ",\"tid\":" << _bufs[i]->_tid
+             << ",\"args\":{" << e._args << "}}";
+         first = false;
+      }
+      events.clear();
+   }
+   ofs << "\n],\"displayTimeUnit\":\"ms\"}" << endl;
+   if (!ofs) {
+      cerr << "Error: cannot write trace file \"" << _file << "\"!!" << endl;
+      return false;
+   }
+   return true;
+}
+
+size_t
+CmdTracer::numEvents()
+{
+   lock_guard<mutex> lock(_mutex);
+   size_t total = 0;
+   for (size_t i = 0, n = _bufs.size(); i < n; ++i)
+      total += _bufs[i]->_events.size();
+   return total;
+}
+
+void
+CmdTracer::add(const string& name, const string& args, double ts)
+{
+   if (!isOn()) return;
+   CmdTraceEvent e;
+   e._name = name;
+   e._args = args;
+   e._ts = ts;
+   e._dur = now() - ts;
+   getBuf()->_events.push_back(e);
+}
+
+// The buffer of the calling thread; registered on its first call
+CmdTracer::CmdTraceBuf*
+CmdTracer::getBuf()
+{
+   static thread_local CmdTraceBuf* buf = 0;
+   if (buf == 0) {
+      lock_guard<mutex> lock(_mutex);
+      buf = new CmdTraceBuf;
+      buf->_tid = _bufs.size() + 1;
+      _bufs.push_back(buf);
+   }
+   return buf;
+}
+
+
+//----------------------------------------------------------------------
+//    Member Function for class CmdTraceSpan
+//----------------------------------------------------------------------
+void
+CmdTraceSpan::addArg(const char* key, const string& val)
+{
+   if (!_on) return;
+   if (_args.size()) _args += ',';
+   _args += jsonStr(key) + ':' + jsonStr(val);
+}
+
+void
+CmdTraceSpan::addArg(const char* key, size_t val)
+{
+   if (!_on) return;
+   if (_args.size()) _args += ',';
+   _args += jsonStr(key) + ':' + to_string(val);
+}
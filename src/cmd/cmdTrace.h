@@ -0,0 +1,110 @@
+/****************************************************************************
+  FileName     [ cmdTrace.h ]
+  PackageName  [ cmd ]
+  Synopsis     [ Define class CmdTracer for Chrome trace export ]
+  Author       [ Chung-Yang (Ric) Huang ]
+  Copyright    [ Copyleft(c) 2007-present LaDs(III), GIEE, NTU, Taiwan ]
+****************************************************************************/
+#ifndef CMD_TRACE_H
+#define CMD_TRACE_H
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+
+using namespace std;
+
+//----------------------------------------------------------------------
+//    Forward Declaration
+//----------------------------------------------------------------------
+class CmdTracer;
+class CmdTraceSpan;
+
+//----------------------------------------------------------------------
+//    External declaration
+//----------------------------------------------------------------------
+extern CmdTracer cmdTracer;
+
+
+//----------------------------------------------------------------------
+//    Class : CmdTracer
+//----------------------------------------------------------------------
+// Records CmdTraceSpan's and writes them to a Chrome trace JSON file
+// (chrome://tracing, Perfetto) when stopped, or at exit.
+//
+// Each thread appends to a buffer of its own, which is only locked to be
+// registered on its first span. stop() must not race with the spans of
+// other threads.
+//
+class CmdTracer
+{
+   struct CmdTraceEvent
+   {
+      string     _name;
+      string     _args;              // JSON object members, escaped
+      double     _ts;                // us since start()
+      double     _dur;               // us
+   };
+
+   struct CmdTraceBuf
+   {
+      unsigned               _tid;
+      vector<CmdTraceEvent>  _events;
+   };
+
+public:
+   CmdTracer() : _on(false) {}
+   ~CmdTracer();
+
+   bool start(const string& file);
+   bool stop();
+   bool isOn() const { return _on.load(memory_order_relaxed); }
+   const string& getFile() const { return _file; }
+   size_t numEvents();
+
+   double now() const {
+      return chrono::duration<double, micro>
+                (chrono::steady_clock::now() - _start).count(); }
+
+private:
+   friend class CmdTraceSpan;
+   void add(const string& name, const string& args, double ts);
+   CmdTraceBuf* getBuf();
+
+   atomic<bool>                  _on;
+   string                        _file;
+   chrono::steady_clock::time_point _start;
+   mutex                         _mutex;  // guards _bufs
+   vector<CmdTraceBuf*>          _bufs;
+};
+
+
+//----------------------------------------------------------------------
+//    Class : CmdTraceSpan
+//----------------------------------------------------------------------
+// A span from its construction to its destruction. It does nothing
+// unless cmdTracer is on when it is constructed.
+//
+class CmdTraceSpan
+{
+public:
+   CmdTraceSpan(const char* name) : _on(cmdTracer.isOn()), _ts(0) {
+      if (_on) { _name = name; _ts = cmdTracer.now(); } }
+   ~CmdTraceSpan() { if (_on) cmdTracer.add(_name, _args, _ts); }
+
+   bool isOn() const { return _on; }
+   void cancel() { _on = false; }
+   void setName(const string& name) { _name = name; }
+   void addArg(const char* key, const string& val);
+   void addArg(const char* key, size_t val);
+
+private:
+   bool      _on;
+   double    _ts;
+   string    _name;
+   string    _args;
+};
+
+#endif // CMD_TRACE_H
@@ -1,6 +1,6 @@
 PKGFLAG   =
-EXTHDRS   = cmdParser.h cmdCharDef.h
-EXTRAOBJS = cmdReader.o
+EXTHDRS   = cmdParser.h cmdCharDef.h cmdTrace.h
+EXTRAOBJS =
 
 include ../Makefile.in
 include ../Makefile.lib
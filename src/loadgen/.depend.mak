@@ -0,0 +1,3 @@
+loadgen.o: loadgen.cpp ../../include/util.h ../../include/myStat.h \
+ ../../include/myAlloc.h ../../include/myShm.h ../../include/cmdParser.h \
+ ../../include/cmdCharDef.h ../../include/myAlloc.h
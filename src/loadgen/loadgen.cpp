@@ -0,0 +1,491 @@
+/****************************************************************************
+  FileName     [ loadgen.cpp ]
+  PackageName  [ loadgen ]
+  Synopsis     [ Synthetic command-stream load generator for CmdParser ]
+  Author       [ Chung-Yang (Ric) Huang ]
+  Copyright    [ Copyleft(c) 2007-present LaDs(III), GIEE, NTU, Taiwan ]
+****************************************************************************/
+#include <cstdlib>
+#include <cstdio>
+#include <cmath>
+#include <csignal>
+#include <chrono>
+#include <random>
+#include <iomanip>
+#include <algorithm>
+#include <thread>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include "util.h"
+#include "myStat.h"
+#include "myAlloc.h"
+#include "myShm.h"
+#include "cmdParser.h"
+
+using namespace std;
+
+//----------------------------------------------------------------------
+//    Global cmd Manager
+//----------------------------------------------------------------------
+CmdParser* cmdMgr = 0;
+
+//----------------------------------------------------------------------
+//    Class : SynthCmd
+//----------------------------------------------------------------------
+// A synthetic command; it only splits its options
+//
+class SynthCmd: public CmdExec
+{
+public:
+   SynthCmd(const string& name) : _name(name) {}
+   ~SynthCmd() {}
+   CmdExecStatus exec(const string& option) {
+      vector<string> options;
+      lexOptions(option, options);
+      return CMD_EXEC_DONE;
+   }
+   void usage(ostream& os) const { os << "Usage: " << _name << endl; }
+   void help() const {
+      cout << setw(15) << left << _name + ": " << "synthetic command" << endl;
+   }
+private:
+   string  _name;
+};
+
+struct LoadCmd
+{
+   string    _name;
+   unsigned  _nCmp;
+};
+
+enum LoadLineKind
+{
+   LOAD_VALID   = 0,  // full command name, a few options
+   LOAD_ABBREV  = 1,  // abbreviated name in mixed case, a few options
+   LOAD_ILLEGAL = 2,  // misspelt name
+   LOAD_OPTIONS = 3,  // full command name, many options
+
+   // dummy
+   LOAD_TOT
+};
+
+// The commands of myexe used with "-Pipe" and "-Shm"; their valid lines
+// take one integer option
+static const LoadCmd pipeCmds[] = {
+   { "HIStory", 3 }, { "HELp", 3 }, { "MYPKGCmd", 3 }
+};
+
+//----------------------------------------------------------------------
+//    Global static funcitons
+//----------------------------------------------------------------------
+static mt19937 rng;
+
+static void
+usage()
+{
+   cout << "Usage: loadgen [ -Commands < n > ] [ -Length < n > ]"
+        << " [ -Prefix < percent > ]\n"
+        << "               [ -Lines < n > ] [ -Mix < valid > < abbrev >"
+        << " < illegal > < options > ]\n"
+        << "               [ -Seed < n > ] [ -Register < n > ]"
+        << "\n               [ -Output < file > | -Pipe < exe > |"
+        << " -Shm < exe > ]" << endl;
+}
+
+static void
+myexit()
+{
+   usage();
+   exit(-1);
+}
+
+static int
+getInt(int argc, char** argv, int& i, int min)
+{
+   int num;
+   if (++i == argc || !myStr2Int(argv[i], num) || num < min) myexit();
+   return num;
+}
+
+// Uniform in [lo, hi]
+static unsigned
+randIn(unsigned lo, unsigned hi)
+{
+   return lo + rng() % (hi - lo + 1);
+}
+
+static char
+randLetter()
+{
+   return 'a' + rng() % 26;
+}
+
+// Register "nCmds" commands with names of about "len" chars, "prefix"
+// percent of which share a prefix with an earlier one
+static bool
+regSynthCmds(int nCmds, int len, int prefix, vector<LoadCmd>& cmds)
+{
+   unsigned lo = max(2, len / 2), hi = max(int(lo), len * 3 / 2);
+   for (int tries = 0; int(cmds.size()) < nCmds; ++tries) {
+      if (tries > 100 * nCmds) {
+         cerr << "Error: only " << cmds.size() << " commands can be "
+              << "registered!!" << endl;
+         return false;
+      }
+      unsigned n = randIn(lo, hi), shared = 0;
+      string name;
+      if (cmds.size() && int(rng() % 100) < prefix) {
+         const string& base = cmds[rng() % cmds.size()]._name;
+         shared = randIn(1, min(n, unsigned(base.size())) - 1);
+         name = base.substr(0, shared);
+      }
+      while (name.size() < n) name += randLetter();
+      // The shortest mandatory part that is not ambiguous
+      for (unsigned nCmp = randIn(shared + 1, n); nCmp <= n; ++nCmp) {
+         string cmd = name;
+         for (unsigned i = 0; i < nCmp; ++i) cmd[i] = toupper(cmd[i]);
+         CmdExec* e = new SynthCmd(cmd);
+         if (cmdMgr->regCmd(cmd, nCmp, e)) {
+            LoadCmd c = { cmd, nCmp };
+            cmds.push_back(c);
+            break;
+         }
+         delete e;
+      }
+   }
+   return true;
+}
+
+static void
+addOptions(string& line, size_t n, bool pipe)
+{
+   for (size_t i = 0; i < n; ++i) {
+      if (pipe) line += " " + to_string(rng() % 100);
+      else if (rng() % 2) line += " -opt" + to_string(rng() % 1000);
+      else line += " value" + to_string(rng() % 100000);
+   }
+}
+
+static string
+genLine(const vector<LoadCmd>& cmds, const int mix[], bool pipe)
+{
+   unsigned k = rng() % 100, kind = 0;
+   for (int sum = mix[0]; kind + 1 < LOAD_TOT && int(k) >= sum; )
+      sum += mix[++kind];
+   const LoadCmd& cmd = cmds[rng() % cmds.size()];
+   string line;
+   switch (kind) {
+      case LOAD_VALID:
+         line = cmd._name;
+         addOptions(line, pipe? 1: rng() % 3, pipe);
+         break;
+      case LOAD_ABBREV:
+         line = cmd._name.substr(0, randIn(cmd._nCmp, cmd._name.size()));
+         for (size_t i = 0; i < line.size(); ++i)
+            line[i] = (rng() % 2)? toupper(line[i]): tolower(line[i]);
+         addOptions(line, pipe? 1: rng() % 3, pipe);
+         break;
+      case LOAD_ILLEGAL:
+         line = cmd._name;
+         do line[rng() % cmd._nCmp] = randLetter();
+         while (cmdMgr->getCmd(line) != 0);
+         addOptions(line, rng() % 3, pipe);
+         break;
+      default:
+         line = cmd._name;
+         addOptions(line, randIn(16, 64), pipe);
+         break;
+   }
+   return line;
+}
+
+static size_t
+rssKB()
+{
+   size_t pages = 0, rss = 0;
+   FILE* fp = fopen("/proc/self/statm", "r");
+   if (fp) {
+      if (fscanf(fp, "%zu %zu", &pages, &rss) != 2) rss = 0;
+      fclose(fp);
+   }
+   return rss * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+class NullBuf: public streambuf
+{
+protected:
+   int overflow(int ch) { return ch; }
+   streamsize xsputn(const char*, streamsize n) { return n; }
+};
+
+// Execute "lines" with CmdParser::execCmdLine(), output discarded, while
+// another thread registers "nRegs" more commands of about "len" chars
+static void
+driveInProcess(const vector<string>& lines, int nRegs, int len)
+{
+   vector<double> us(lines.size());
+   size_t nErrors = 0, rss = rssKB();
+   AllocStats allocs = getAllocTotal();
+   resetStats();
+
+   NullBuf null;
+   streambuf* coutBuf = cout.rdbuf(&null);
+   streambuf* cerrBuf = cerr.rdbuf(&null);
+   vector<LoadCmd> regs;
+   thread regThread;
+   if (nRegs > 0)
+      regThread = thread([&] { regSynthCmds(nRegs, len, 0, regs); });
+   chrono::steady_clock::time_point start = chrono::steady_clock::now();
+   for (size_t i = 0, n = lines.size(); i < n; ++i) {
+      chrono::steady_clock::time_point t = chrono::steady_clock::now();
+      if (cmdMgr->execCmdLine(lines[i]) != CMD_EXEC_DONE) ++nErrors;
+      us[i] = chrono::duration<double, micro>
+                 (chrono::steady_clock::now() - t).count();
+   }
+   double ms = chrono::duration<double, milli>
+                  (chrono::steady_clock::now() - start).count();
+   if (regThread.joinable()) regThread.join();
+   cout.rdbuf(coutBuf);
+   cerr.rdbuf(cerrBuf);
+   AllocStats after = getAllocTotal();
+
+   sort(us.begin(), us.end());
+   size_t n = us.size();
+   cout << fixed << setprecision(3)
+        << "Lines    : " << n << " (" << nErrors << " not done) in "
+        << ms << " ms" << endl
+        << setprecision(1)
+        << "Rate     : " << n / ms * 1000 << " lines/s" << endl
+        << setprecision(3)
+        << "Latency  : P50 " << us[n / 2] << " us, P90 "
+        << us[size_t(ceil(0.9 * n)) - 1] << " us, P99 "
+        << us[size_t(ceil(0.99 * n)) - 1] << " us, max " << us[n - 1]
+        << " us" << endl
+        << "Lookups  : " << statGet(STAT_CMD_LOOKUPS) << " ("
+        << setprecision(1) << double(statGet(STAT_CMD_SCANNED)) /
+                              max(statGet(STAT_CMD_LOOKUPS), size_t(1))
+        << " entries scanned each)" << endl
+        << "Memory   : RSS +" << rssKB() - rss << " KB, "
+        << after._allocs - allocs._allocs << " allocs, "
+        << after._frees - allocs._frees << " frees, "
+        << (after._bytes - allocs._bytes) / 1024 << " KB allocated" << endl;
+   if (nRegs > 0)
+      cout << "Register : " << regs.size() << " commands meanwhile" << endl;
+}
+
+// Feed "lines" to "exe" through a pipe, its output discarded
+static bool
+drivePipe(const vector<string>& lines, const string& exe)
+{
+   int fds[2];
+   if (pipe(fds) != 0) {
+      cerr << "Error: cannot create a pipe!!" << endl;
+      return false;
+   }
+   chrono::steady_clock::time_point start = chrono::steady_clock::now();
+   pid_t pid = fork();
+   if (pid == 0) {
+      int null = open("/dev/null", O_WRONLY);
+      dup2(fds[0], 0);
+      dup2(null, 1);
+      dup2(null, 2);
+      close(fds[0]);
+      close(fds[1]);
+      execl(exe.c_str(), exe.c_str(), (char*)0);
+      _exit(127);
+   }
+   close(fds[0]);
+   signal(SIGPIPE, SIG_IGN);
+   if (pid < 0) {
+      close(fds[1]);
+      cerr << "Error: cannot run \"" << exe << "\"!!" << endl;
+      return false;
+   }
+   string buf;
+   for (size_t i = 0, n = lines.size(); i <= n; ++i) {
+      if (i < n) buf += lines[i] + '\n';
+      else buf += "Quit -Force\n";
+      if (buf.size() < (1 << 16) && i < n) continue;
+      for (size_t b = 0; b < buf.size(); ) {
+         ssize_t w = ::write(fds[1], buf.data() + b, buf.size() - b);
+         if (w <= 0) break;
+         b += w;
+      }
+      buf.clear();
+   }
+   close(fds[1]);
+   int status;
+   struct rusage ru;
+   wait4(pid, &status, 0, &ru);
+   double ms = chrono::duration<double, milli>
+                  (chrono::steady_clock::now() - start).count();
+   if (!WIFEXITED(status) || WEXITSTATUS(status) == 127) {
+      cerr << "Error: \"" << exe << "\" did not finish normally!!" << endl;
+      return false;
+   }
+   size_t n = lines.size();
+   cout << fixed << setprecision(3)
+        << "Lines    : " << n << " in " << ms << " ms" << endl
+        << setprecision(1)
+        << "Rate     : " << n / ms * 1000 << " lines/s" << endl
+        << "Latency  : (not measured through a pipe)" << endl
+        << "Memory   : peak RSS " << ru.ru_maxrss << " KB" << endl;
+   return true;
+}
+
+// Send "lines" one at a time to "exe" through a shared-memory channel,
+// timing the round trip of each
+static bool
+driveShm(const vector<string>& lines, const string& exe)
+{
+   string file = "/dev/shm/loadgen." + to_string(getpid());
+   pid_t pid = fork();
+   if (pid == 0) {
+      int null = open("/dev/null", O_RDWR);
+      dup2(null, 0);
+      dup2(null, 1);
+      dup2(null, 2);
+      execl(exe.c_str(), exe.c_str(), "-Shm", file.c_str(), (char*)0);
+      _exit(127);
+   }
+   ShmChannel channel;
+   if (pid < 0 || !channel.attach(file)) {
+      cerr << "Error: cannot connect to \"" << exe << "\"!!" << endl;
+      if (pid > 0) kill(pid, SIGTERM);
+      return false;
+   }
+
+   size_t n = lines.size(), nErrors = 0;
+   vector<double> us(n), execUs(n);
+   ShmReply reply;
+   chrono::steady_clock::time_point start = chrono::steady_clock::now();
+   for (size_t i = 0; i < n; ++i) {
+      chrono::steady_clock::time_point t = chrono::steady_clock::now();
+      if (!channel.exec(lines[i], reply)) {
+         cerr << "Error: \"" << exe << "\" is gone after " << i
+              << " lines!!" << endl;
+         kill(pid, SIGTERM);
+         return false;
+      }
+      us[i] = chrono::duration<double, micro>
+                 (chrono::steady_clock::now() - t).count();
+      execUs[i] = reply._us;
+      if (reply._status != CMD_EXEC_DONE) ++nErrors;
+   }
+   double ms = chrono::duration<double, milli>
+                  (chrono::steady_clock::now() - start).count();
+   channel.exec("Quit -Force", reply);
+   channel.close();
+   int status;
+   struct rusage ru;
+   wait4(pid, &status, 0, &ru);
+
+   sort(us.begin(), us.end());
+   sort(execUs.begin(), execUs.end());
+   cout << fixed << setprecision(3)
+        << "Lines    : " << n << " (" << nErrors << " not done) in "
+        << ms << " ms" << endl
+        << setprecision(1)
+        << "Rate     : " << n / ms * 1000 << " lines/s" << endl
+        << setprecision(3)
+        << "Latency  : P50 " << us[n / 2] << " us, P90 "
+        << us[size_t(ceil(0.9 * n)) - 1] << " us, P99 "
+        << us[size_t(ceil(0.99 * n)) - 1] << " us, max " << us[n - 1]
+        << " us (round trip)" << endl
+        << setprecision(0)
+        << "Execute  : P50 " << execUs[n / 2] << " us, P99 "
+        << execUs[size_t(ceil(0.99 * n)) - 1] << " us (in " << exe << ")"
+        << endl
+        << "Memory   : peak RSS " << ru.ru_maxrss << " KB" << endl;
+   return true;
+}
+
+int
+main(int argc, char** argv)
+{
+   int nCmds = 100, len = 8, prefix = 50, nLines = 100000, seed = 1;
+   int nRegs = 0;
+   int mix[LOAD_TOT] = { 60, 20, 10, 10 };
+   string outFile, exe;
+   bool shm = false;
+   for (int i = 1; i < argc; ++i) {
+      if (myStrNCmp("-Commands", argv[i], 2) == 0)
+         nCmds = getInt(argc, argv, i, 1);
+      else if (myStrNCmp("-Length", argv[i], 2) == 0)
+         len = getInt(argc, argv, i, 2);
+      else if (myStrNCmp("-Prefix", argv[i], 2) == 0) {
+         prefix = getInt(argc, argv, i, 0);
+         if (prefix > 100) myexit();
+      }
+      else if (myStrNCmp("-Lines", argv[i], 2) == 0)
+         nLines = getInt(argc, argv, i, 1);
+      else if (myStrNCmp("-Mix", argv[i], 2) == 0) {
+         int sum = 0;
+         for (int k = 0; k < LOAD_TOT; ++k)
+            sum += (mix[k] = getInt(argc, argv, i, 0));
+         if (sum != 100) {
+            cerr << "Error: the mix must add up to 100!!" << endl;
+            myexit();
+         }
+      }
+      else if (myStrNCmp("-Seed", argv[i], 2) == 0)
+         seed = getInt(argc, argv, i, 0);
+      else if (myStrNCmp("-Register", argv[i], 2) == 0)
+         nRegs = getInt(argc, argv, i, 0);
+      else if (myStrNCmp("-Output", argv[i], 2) == 0) {
+         if (++i == argc || exe.size()) myexit();
+         outFile = argv[i];
+      }
+      else if (myStrNCmp("-Pipe", argv[i], 2) == 0) {
+         if (++i == argc || outFile.size() || exe.size()) myexit();
+         exe = argv[i];
+      }
+      else if (myStrNCmp("-Shm", argv[i], 3) == 0) {
+         if (++i == argc || outFile.size() || exe.size()) myexit();
+         exe = argv[i];
+         shm = true;
+      }
+      else {
+         cerr << "Error: unknown argument \"" << argv[i] << "\"!!\n";
+         myexit();
+      }
+   }
+   rng.seed(seed);
+
+   // With "-Pipe" or "-Shm", the commands stand in for those of the
+   // executable
+   cmdMgr = new CmdParser("loadgen> ");
+   vector<LoadCmd> cmds;
+   if (exe.size()) {
+      for (size_t i = 0; i < sizeof(pipeCmds) / sizeof(pipeCmds[0]); ++i) {
+         cmdMgr->regCmd(pipeCmds[i]._name, pipeCmds[i]._nCmp,
+                        new SynthCmd(pipeCmds[i]._name));
+         cmds.push_back(pipeCmds[i]);
+      }
+   }
+   else if (!regSynthCmds(nCmds, len, prefix, cmds))
+      return 1;
+
+   vector<string> lines(nLines);
+   for (int i = 0; i < nLines; ++i)
+      lines[i] = genLine(cmds, mix, exe.size());
+
+   if (outFile.size()) {
+      ofstream ofs(outFile.c_str());
+      for (int i = 0; i < nLines; ++i) ofs << lines[i] << '\n';
+      if (!ofs) {
+         cerr << "Error: cannot write file \"" << outFile << "\"!!\n";
+         return 1;
+      }
+      return 0;
+   }
+   cout << "Commands : " << cmds.size() << endl;
+   if (shm)
+      return driveShm(lines, exe)? 0: 1;
+   if (exe.size())
+      return drivePipe(lines, exe)? 0: 1;
+   driveInProcess(lines, nRegs, len);
+   return 0;
+}
@@ -1,2 +1,4 @@
-main.o: main.cpp ../../include/util.h ../../include/cmdParser.h \
-  ../../include/cmdCharDef.h
+main.o: main.cpp ../../include/util.h ../../include/myStat.h \
+ ../../include/myEvent.h ../../include/cmdParser.h \
+ ../../include/cmdCharDef.h ../../include/myAlloc.h \
+ ../../include/cmdTrace.h
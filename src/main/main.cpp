@@ -6,23 +6,36 @@
   Copyright    [ Copyleft(c) 2007-present LaDs(III), GIEE, NTU, Taiwan ]
 ****************************************************************************/
 #include <cstdlib>
+#include <chrono>
+#include <iomanip>
+#include <unistd.h>
+#include <climits>
+#include <sstream>
 #include "util.h"
+#include "myStat.h"
+#include "myEvent.h"
 #include "cmdParser.h"
+#include "cmdTrace.h"
 
 using namespace std;
 
 //----------------------------------------------------------------------
 //    Global cmd Manager
 //----------------------------------------------------------------------
-CmdParser* cmdMgr = new CmdParser("mydb> ");
+CmdParser* cmdMgr = 0;
 
 extern bool initCommonCmd();
-extern bool initDbCmd();
+
+// TODO: command packages, linked in or built as lib<pkg>.so (see Makefile)
+static const char* cmdPkgs[] = { "mypkg" };
 
 static void
 usage()
 {
-   cout << "Usage: modCalc [ -File < doFile > ]" << endl;
+   cout << "Usage: modCalc [ -File < doFile > | -Command < \"cmd; ...\" > ]"
+        << " [ -Time ] [ -Trace < traceFile > ] [ -Budget < ms > ]"
+        << " [ -Protocol | -Shm < file > ] [ -Restore < sessionFile > ]"
+        << endl;
 }
 
 static void
@@ -32,30 +45,188 @@ myexit()
    exit(-1);
 }
 
+// Shared command packages are looked up in $CMD_PKG_DIR, or in "../lib"
+// relative to the executable
+static string
+pkgDir()
+{
+   const char* env = getenv("CMD_PKG_DIR");
+   if (env) return env;
+   char path[PATH_MAX];
+   ssize_t n = readlink("/proc/self/exe", path, PATH_MAX - 1);
+   if (n <= 0) return "lib";
+   string exe(path, n);
+   return exe.substr(0, exe.find_last_of('/') + 1) + "../lib";
+}
+
+typedef chrono::steady_clock::time_point TimePoint;
+
+static double
+elapsedMs(const TimePoint& from)
+{
+   return chrono::duration<double, milli>
+             (chrono::steady_clock::now() - from).count();
+}
+
+// Print the time from entering main() to being ready for the first
+// command, and the part of it spent on each step of the setup.
+// "restoreMs" < 0: no session restored.
+static void
+reportStartTime(double parserMs, double commonMs, double restoreMs,
+                double totalMs)
+{
+   cerr << fixed << setprecision(3)
+        << "Startup: " << totalMs << " ms (parser " << parserMs
+        << " ms, common commands " << commonMs << " ms, ";
+   if (restoreMs >= 0) cerr << "session " << restoreMs << " ms, ";
+   cerr << "packages " << (cmdMgr->pkgsPending()? "deferred": "loaded")
+        << ")" << endl;
+}
+
+// Execute "cmds" as a dofile whose lines are separated by ';' ("\;" for a
+// ';' in a line), so that SET, FOR, WHILE and IF blocks can span lines.
+// Return CMD_EXEC_ERROR if any command fails; stop if one is interrupted.
+static CmdExecStatus
+execCmdString(const string& cmds)
+{
+   string text;
+   for (size_t i = 0, n = cmds.size(); i < n; ++i) {
+      if (cmds[i] == '\\' && i + 1 < n && cmds[i + 1] == ';')
+         text += cmds[++i];
+      else if (cmds[i] != ';') text += cmds[i];
+      else {
+         text += '\n';
+         while (i + 1 < n && cmds[i + 1] == ' ') ++i;
+      }
+   }
+   text += '\n';
+   if (!cmdMgr->openDofile(new istringstream(text), "-Command"))
+      return CMD_EXEC_ERROR;
+
+   CmdExecStatus result = CMD_EXEC_DONE;
+   CmdExecStatus status = CMD_EXEC_DONE;
+   while (status != CMD_EXEC_QUIT && cmdMgr->inDofile()) {
+      status = cmdMgr->execOneCmd();
+      cout << endl;
+      if (status == CMD_EXEC_ERROR || status == CMD_EXEC_INTERRUPTED)
+         result = CMD_EXEC_ERROR;
+      if (status == CMD_EXEC_INTERRUPTED) break;
+   }
+   return result;
+}
+
 int
 main(int argc, char** argv)
 {
-   ifstream dof;
+   TimePoint start = chrono::steady_clock::now();
+   countOutput(cout);
+   myEventLoop();                    // of this thread, the main one
 
-   if (argc == 3) {  // -file <doFile>
-      if (myStrNCmp("-File", argv[1], 2) == 0) {
-         if (!cmdMgr->openDofile(argv[2])) {
-            cerr << "Error: cannot open file \"" << argv[2] << "\"!!\n";
+   cmdMgr = new CmdParser("mydb> ");
+   double parserMs = elapsedMs(start);
+
+   string dofile, cmds, traceFile, shmFile, sessionFile;
+   bool hasCmds = false, reportTime = false, protocol = false;
+   bool hasBudget = false;
+   int budget = 0;
+   for (int i = 1; i < argc; ++i) {
+      if (myStrNCmp("-File", argv[i], 2) == 0) {
+         if (++i == argc || dofile.size() || hasCmds) myexit();
+         dofile = argv[i];
+      }
+      else if (myStrNCmp("-Command", argv[i], 2) == 0) {
+         if (++i == argc || dofile.size() || hasCmds) myexit();
+         cmds = argv[i];
+         hasCmds = true;
+      }
+      else if (myStrNCmp("-Time", argv[i], 3) == 0)
+         reportTime = true;
+      else if (myStrNCmp("-Trace", argv[i], 3) == 0) {
+         if (++i == argc || traceFile.size()) myexit();
+         traceFile = argv[i];
+      }
+      else if (myStrNCmp("-Protocol", argv[i], 2) == 0 ||
+               string(argv[i]) == "--protocol")
+         protocol = true;
+      else if (myStrNCmp("-Shm", argv[i], 2) == 0) {
+         if (++i == argc || shmFile.size()) myexit();
+         shmFile = argv[i];
+      }
+      else if (myStrNCmp("-Budget", argv[i], 2) == 0) {
+         if (++i == argc || !myStr2Int(argv[i], budget) || budget < 0)
             myexit();
-         }
+         hasBudget = true;
+      }
+      else if (myStrNCmp("-Restore", argv[i], 2) == 0) {
+         if (++i == argc || sessionFile.size()) myexit();
+         sessionFile = argv[i];
       }
       else {
-         cerr << "Error: unknown argument \"" << argv[1] << "\"!!\n";
+         cerr << "Error: unknown argument \"" << argv[i] << "\"!!\n";
          myexit();
       }
    }
-   else if (argc != 1) {
-      cerr << "Error: illegal number of argument (" << argc << ")!!\n";
+
+   if ((protocol || shmFile.size()) && (dofile.size() || hasCmds))
+      myexit();
+   if (protocol && shmFile.size()) myexit();
+
+   if (traceFile.size() && !cmdTracer.start(traceFile)) {
+      cerr << "Error: cannot open file \"" << traceFile << "\"!!\n";
+      myexit();
+   }
+
+   // Ctrl-C and the time budgets cancel the running command only
+   initCmdCancel();
+   cmdMgr->setBudget(budget);
+
+   // The protocol modes read stdin themselves
+   if (!protocol && shmFile.empty())
+      initTermInput();
+
+   if (dofile.size() && !cmdMgr->openDofile(dofile)) {
+      cerr << "Error: cannot open file \"" << dofile << "\"!!\n";
       myexit();
    }
 
-   if (!initCommonCmd() || !initDbCmd())
+   TimePoint commonStart = chrono::steady_clock::now();
+   if (!initCommonCmd())
       return 1;
+   double commonMs = elapsedMs(commonStart);
+
+   // Package commands are registered on the first lookup that needs them
+   cmdMgr->setPkgDir(pkgDir());
+   for (size_t i = 0; i < sizeof(cmdPkgs) / sizeof(cmdPkgs[0]); ++i)
+      cmdMgr->addPkg(cmdPkgs[i]);
+
+   // The session's budgets, unless -Budget is given; its dofiles are
+   // resumed unless -File is given
+   double restoreMs = -1;
+   if (sessionFile.size()) {
+      TimePoint restoreStart = chrono::steady_clock::now();
+      if (!cmdMgr->loadSession(sessionFile)) {
+         cerr << "Error: cannot restore session \"" << sessionFile
+              << "\"!!\n";
+         return 1;
+      }
+      if (hasBudget) cmdMgr->setBudget(budget);
+      restoreMs = elapsedMs(restoreStart);
+   }
+
+   if (reportTime)
+      reportStartTime(parserMs, commonMs, restoreMs, elapsedMs(start));
+
+   if (hasCmds)
+      return (execCmdString(cmds) == CMD_EXEC_ERROR)? 1: 0;
+
+   // Requests and responses on stdin and stdout (see cmdProtocol.h)
+   if (protocol) {
+      cmdMgr->execProtocol(0, 1);
+      return 0;
+   }
+   // Requests and replies through a shared-memory channel (see myShm.h)
+   if (shmFile.size())
+      return cmdMgr->execShm(shmFile)? 0: 1;
 
    CmdExecStatus status = CMD_EXEC_DONE;
    while (status != CMD_EXEC_QUIT) {  // until "quit" or command error
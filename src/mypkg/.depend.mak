@@ -1,3 +1,4 @@
-mypkgCmd.o: mypkgCmd.cpp ../../include/util.h mypkgCmd.h \
- ../../include/cmdParser.h ../../include/cmdCharDef.h mypkg.h
 mypkg.o: mypkg.cpp mypkg.h ../../include/util.h
+mypkgCmd.o: mypkgCmd.cpp ../../include/util.h mypkgCmd.h \
+ ../../include/cmdParser.h ../../include/cmdCharDef.h \
+ ../../include/myAlloc.h mypkg.h
@@ -18,10 +18,26 @@ initDbCmd()
      cerr << "Registering \"init\" commands fails... exiting" << endl;
      return false;
   }
+  // TODO: mark read-only queries as pure so that their results are cached
+  //       e.g. cmdMgr->getCmd("DBQuery")->setPure(&dbEpoch);
+  //       where dbEpoch is bumped by every command that changes the db
+  // TODO: let DOPARallel run commands on separate objects in parallel
+  //       by declaring their classes with CmdAccessClass() and defining
+  //       CmdExec::getAccess(), e.g.
+  //       bool DBQuery::getAccess(const string& option, CmdAccess& acc) const
+  //       { acc._reads.push_back("db"); return true; }
+  // TODO: keep the db in SAVEsession files by registering a CmdSnapshot
+  //       like CmdCacheSnapshot in src/cmd/cmdCache.cpp, e.g.
+  //       static DbSnapshot dbSnapshot;
+  //       cmdMgr->regSnapshot("mypkg", &dbSnapshot);
 
    return true;
 }
 
+// TODO: package name
+// Entry point for loading the package, either linked in or as libmypkg.so
+CmdPkgEntry(mypkg, initDbCmd)
+
 // TODO: define methods for commands
 // inspect src/cmd/cmdCommon.h & cmdCommon.cpp for some examples
 //----------------------------------------------------------------------
@@ -35,7 +51,8 @@ MYPKGCmd::exec(const string& option)
         CMD_EXEC_DONE ,
         CMD_EXEC_ERROR,
         CMD_EXEC_QUIT ,
-        CMD_EXEC_NOP
+        CMD_EXEC_NOP  ,
+        CMD_EXEC_INTERRUPTED   // when cmdInterrupted() is polled true
     }
     */
 
@@ -1,3 +1,7 @@
+myAlloc.o: myAlloc.cpp myAlloc.h
+myEvent.o: myEvent.cpp myEvent.h
 myGetChar.o: myGetChar.cpp
+myShm.o: myShm.cpp myShm.h
+myStat.o: myStat.cpp myStat.h
 myString.o: myString.cpp
-util.o: util.cpp
+util.o: util.cpp myStat.h
@@ -1,4 +1,16 @@
-util.d: ../../include/util.h 
+util.d: ../../include/util.h ../../include/myStat.h ../../include/myAlloc.h ../../include/myShm.h ../../include/myEvent.h 
 ../../include/util.h: util.h
 	@rm -f ../../include/util.h
 	@ln -fs ../src/util/util.h ../../include/util.h
+../../include/myStat.h: myStat.h
+	@rm -f ../../include/myStat.h
+	@ln -fs ../src/util/myStat.h ../../include/myStat.h
+../../include/myAlloc.h: myAlloc.h
+	@rm -f ../../include/myAlloc.h
+	@ln -fs ../src/util/myAlloc.h ../../include/myAlloc.h
+../../include/myShm.h: myShm.h
+	@rm -f ../../include/myShm.h
+	@ln -fs ../src/util/myShm.h ../../include/myShm.h
+../../include/myEvent.h: myEvent.h
+	@rm -f ../../include/myEvent.h
+	@ln -fs ../src/util/myEvent.h ../../include/myEvent.h
@@ -0,0 +1,139 @@
+/****************************************************************************
+  FileName     [ myAlloc.cpp ]
+  PackageName  [ util ]
+  Synopsis     [ Counting replacement of the global operator new/delete ]
+  Author       [ Chung-Yang (Ric) Huang ]
+  Copyright    [ Copyleft(c) 2007-present LaDs(III), GIEE, NTU, Taiwan ]
+****************************************************************************/
+#include <cstdlib>
+#include <new>
+#include <atomic>
+#include <utility>
+#include <malloc.h>
+#include "myAlloc.h"
+
+using namespace std;
+
+//----------------------------------------------------------------------
+//    Global static variables and funcitons
+//----------------------------------------------------------------------
+static atomic<size_t> totalAllocs(0);
+static atomic<size_t> totalFrees(0);
+static atomic<size_t> totalBytes(0);
+
+// The innermost AllocScope of this thread, and the bytes allocated and
+// not freed since it began
+static thread_local AllocStats* curStats = 0;
+static thread_local long long curLive = 0;
+
+static inline void
+noteAlloc(void* p)
+{
+   size_t n = malloc_usable_size(p);
+   totalAllocs.fetch_add(1, memory_order_relaxed);
+   totalBytes.fetch_add(n, memory_order_relaxed);
+   if (curStats) {
+      ++curStats->_allocs;
+      curStats->_bytes += n;
+      curLive += n;
+      if (curLive > (long long)curStats->_peak) curStats->_peak = curLive;
+   }
+}
+
+static inline void
+noteFree(void* p)
+{
+   totalFrees.fetch_add(1, memory_order_relaxed);
+   if (curStats) {
+      ++curStats->_frees;
+      curLive -= malloc_usable_size(p);
+   }
+}
+
+static void*
+allocate(size_t n)
+{
+   if (n == 0) n = 1;
+   void* p;
+   while ((p = malloc(n)) == 0) {
+      new_handler handler = get_new_handler();
+      if (handler == 0) throw bad_alloc();
+      handler();
+   }
+   noteAlloc(p);
+   return p;
+}
+
+static void
+deallocate(void* p)
+{
+   if (p == 0) return;
+   noteFree(p);
+   free(p);
+}
+
+
+//----------------------------------------------------------------------
+//    Global operator new/delete
+//----------------------------------------------------------------------
+void* operator new(size_t n) { return allocate(n); }
+void* operator new[](size_t n) { return allocate(n); }
+
+void*
+operator new(size_t n, const nothrow_t&) noexcept
+{
+   try { return allocate(n); }
+   catch (...) { return 0; }
+}
+
+void*
+operator new[](size_t n, const nothrow_t&) noexcept
+{
+   try { return allocate(n); }
+   catch (...) { return 0; }
+}
+
+void operator delete(void* p) noexcept { deallocate(p); }
+void operator delete[](void* p) noexcept { deallocate(p); }
+void operator delete(void* p, const nothrow_t&) noexcept { deallocate(p); }
+void operator delete[](void* p, const nothrow_t&) noexcept { deallocate(p); }
+
+
+//----------------------------------------------------------------------
+//    Member Function for class AllocScope
+//----------------------------------------------------------------------
+AllocScope::AllocScope(AllocStats* stats)
+: _prevStats(curStats), _prevLive(curLive)
+{
+   ++stats->_scopes;
+   curStats = stats;
+   curLive = 0;
+}
+
+AllocScope::~AllocScope()
+{
+   curStats = _prevStats;
+   curLive = _prevLive;
+}
+
+
+//----------------------------------------------------------------------
+//    Global functions
+//----------------------------------------------------------------------
+// Allocations of all threads since the start, in or out of scopes
+AllocStats
+getAllocTotal()
+{
+   AllocStats total;
+   total._allocs = totalAllocs.load(memory_order_relaxed);
+   total._frees = totalFrees.load(memory_order_relaxed);
+   total._bytes = totalBytes.load(memory_order_relaxed);
+   return total;
+}
+
+void
+swapAllocScope(AllocStats*& stats, long long& live)
+{
+   swap(curStats, stats);
+   swap(curLive, live);
+}
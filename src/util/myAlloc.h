@@ -0,0 +1,54 @@
+/****************************************************************************
+  FileName     [ myAlloc.h ]
+  PackageName  [ util ]
+  Synopsis     [ Define the counters of the global operator new/delete ]
+  Author       [ Chung-Yang (Ric) Huang ]
+  Copyright    [ Copyleft(c) 2007-present LaDs(III), GIEE, NTU, Taiwan ]
+****************************************************************************/
+#ifndef MY_ALLOC_H
+#define MY_ALLOC_H
+
+#include <cstddef>
+
+using namespace std;
+
+//----------------------------------------------------------------------
+//    Class : AllocStats
+//----------------------------------------------------------------------
+// Allocations made by the global operator new/delete (replaced in
+// myAlloc.cpp) are counted in the AllocStats of the innermost AllocScope
+// of the calling thread, if there is one. Bytes are the usable sizes of
+// the blocks returned by malloc().
+//
+struct AllocStats
+{
+   AllocStats() : _scopes(0), _allocs(0), _frees(0), _bytes(0), _peak(0) {}
+
+   size_t    _scopes;                // number of AllocScope's
+   size_t    _allocs;
+   size_t    _frees;
+   size_t    _bytes;                 // bytes allocated
+   size_t    _peak;                  // peak live bytes within a scope
+};
+
+class AllocScope
+{
+public:
+   AllocScope(AllocStats* stats);
+   ~AllocScope();
+
+private:
+   AllocScope(const AllocScope&);
+   AllocScope& operator = (const AllocScope&);
+
+   AllocStats*  _prevStats;
+   long long    _prevLive;
+};
+
+// In myAlloc.cpp
+extern AllocStats getAllocTotal();
+// Exchange the innermost scope of the calling thread with "stats" and
+// "live", for coroutines that switch in and out of their scopes
+extern void swapAllocScope(AllocStats*& stats, long long& live);
+
+#endif // MY_ALLOC_H
@@ -0,0 +1,234 @@
+/****************************************************************************
+  FileName     [ myEvent.cpp ]
+  PackageName  [ util ]
+  Synopsis     [ Define member functions of class EventLoop ]
+  Author       [ Chung-Yang (Ric) Huang ]
+  Copyright    [ Copyleft(c) 2007-present LaDs(III), GIEE, NTU, Taiwan ]
+****************************************************************************/
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <sys/signalfd.h>
+#include "myEvent.h"
+
+using namespace std;
+
+//----------------------------------------------------------------------
+//    Global functions
+//----------------------------------------------------------------------
+EventLoop&
+myEventLoop()
+{
+   static EventLoop loop;
+   return loop;
+}
+
+
+//----------------------------------------------------------------------
+//    Member Function for class EventLoop
+//----------------------------------------------------------------------
+EventLoop::EventLoop()
+: _thread(this_thread::get_id()), _epfd(-1), _postFd(-1), _waitFd(-1),
+  _waitReady(false)
+{
+   _epfd = epoll_create1(EPOLL_CLOEXEC);
+   if (_epfd < 0) return;
+   _postFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+   struct epoll_event ev;
+   ev.events = EPOLLIN;
+   ev.data.fd = _postFd;
+   if (_postFd < 0 || epoll_ctl(_epfd, EPOLL_CTL_ADD, _postFd, &ev) < 0) {
+      if (_postFd >= 0) ::close(_postFd);
+      ::close(_epfd);
+      _epfd = _postFd = -1;
+   }
+}
+
+EventLoop::~EventLoop()
+{
+   // The fds of timers and signals are ours; the others are not
+   for (set<int>::iterator it = _timers.begin(); it != _timers.end(); ++it)
+      ::close(*it);
+   for (map<int, int>::iterator it = _signalFds.begin();
+        it != _signalFds.end(); ++it)
+      ::close(it->second);
+   if (_postFd >= 0) ::close(_postFd);
+   if (_epfd >= 0) ::close(_epfd);
+}
+
+bool
+EventLoop::addFd(int fd, unsigned events, const FdHandler& h)
+{
+   if (_epfd < 0 || _fds.find(fd) != _fds.end()) return false;
+   struct epoll_event ev;
+   ev.events = events;
+   ev.data.fd = fd;
+   if (epoll_ctl(_epfd, EPOLL_CTL_ADD, fd, &ev) < 0) return false;
+   _fds[fd] = h;
+   return true;
+}
+
+bool
+EventLoop::removeFd(int fd)
+{
+   if (_fds.erase(fd) == 0) return false;
+   epoll_ctl(_epfd, EPOLL_CTL_DEL, fd, 0);
+   return true;
+}
+
+// The timer is a timerfd; its fd is the id
+int
+EventLoop::addTimer(unsigned ms, const Handler& h, bool periodic)
+{
+   if (_epfd < 0) return -1;
+   int tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+   if (tfd < 0) return -1;
+   struct itimerspec ts;
+   ts.it_value.tv_sec = ms / 1000;
+   ts.it_value.tv_nsec = (ms % 1000) * 1000000L;
+   if (ms == 0) ts.it_value.tv_nsec = 1;          // 0 would disarm it
+   ts.it_interval = ts.it_value;
+   if (!periodic) ts.it_interval.tv_sec = ts.it_interval.tv_nsec = 0;
+   if (timerfd_settime(tfd, 0, &ts, 0) < 0) {
+      ::close(tfd);
+      return -1;
+   }
+   FdHandler onExpire = [this, tfd, h, periodic](unsigned) {
+      uint64_t n;
+      if (::read(tfd, &n, sizeof(n)) != sizeof(n)) return;
+      if (!periodic) removeTimer(tfd);
+      h();
+   };
+   if (!addFd(tfd, EPOLLIN, onExpire)) {
+      ::close(tfd);
+      return -1;
+   }
+   _timers.insert(tfd);
+   return tfd;
+}
+
+bool
+EventLoop::removeTimer(int id)
+{
+   if (_timers.erase(id) == 0) return false;
+   removeFd(id);
+   ::close(id);
+   return true;
+}
+
+bool
+EventLoop::addSignal(int sig, const Handler& h)
+{
+   if (_epfd < 0 || _signalFds.find(sig) != _signalFds.end()) return false;
+   sigset_t mask;
+   sigemptyset(&mask);
+   sigaddset(&mask, sig);
+   int sfd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+   if (sfd < 0) return false;
+   FdHandler onSignal = [sfd, h](unsigned) {
+      struct signalfd_siginfo si;
+      while (::read(sfd, &si, sizeof(si)) == sizeof(si)) h();
+   };
+   if (!addFd(sfd, EPOLLIN, onSignal)) {
+      ::close(sfd);
+      return false;
+   }
+   pthread_sigmask(SIG_BLOCK, &mask, 0);
+   _signalFds[sig] = sfd;
+   return true;
+}
+
+void
+EventLoop::post(const Handler& h)
+{
+   {
+      lock_guard<mutex> lock(_mutex);
+      _posted.push_back(h);
+   }
+   uint64_t one = 1;
+   if (::write(_postFd, &one, sizeof(one)) < 0) {}
+}
+
+int
+EventLoop::waitFd(int fd, unsigned events, int ms)
+{
+   bool added = false;
+   if (fd >= 0 && _fds.find(fd) == _fds.end()) {
+      struct epoll_event ev;
+      ev.events = events;
+      ev.data.fd = fd;
+      // Not to be watched, e.g. a regular file; it is read as it is
+      if (epoll_ctl(_epfd, EPOLL_CTL_ADD, fd, &ev) < 0) return 1;
+      added = true;
+   }
+   // A handler may wait in turn
+   int oldFd = _waitFd;
+   bool oldReady = _waitReady;
+   _waitFd = fd;
+   _waitReady = false;
+
+   chrono::steady_clock::time_point until =
+      chrono::steady_clock::now() + chrono::milliseconds(ms);
+   int res = 0;
+   while (true) {
+      int left = -1;
+      if (ms >= 0) {
+         long long us = chrono::duration_cast<chrono::microseconds>
+                           (until - chrono::steady_clock::now()).count();
+         left = (us <= 0)? 0: int((us + 999) / 1000);
+      }
+      if (runOnce(left) < 0) { res = -1; break; }
+      if (_waitReady) { res = 1; break; }
+      if (left == 0) break;
+   }
+
+   if (added && _fds.find(fd) == _fds.end())
+      epoll_ctl(_epfd, EPOLL_CTL_DEL, fd, 0);
+   _waitFd = oldFd;
+   _waitReady = oldReady;
+   return res;
+}
+
+int
+EventLoop::runOnce(int ms)
+{
+   if (_epfd < 0) return -1;
+   struct epoll_event evs[16];
+   int n = epoll_wait(_epfd, evs, 16, ms);
+   if (n < 0) return -1;
+   for (int i = 0; i < n; ++i)
+      dispatch(evs[i].data.fd, evs[i].events);
+   return n;
+}
+
+void
+EventLoop::dispatch(int fd, unsigned events)
+{
+   if (fd == _postFd) {
+      uint64_t n;
+      if (::read(_postFd, &n, sizeof(n)) == sizeof(n)) runPosted();
+      return;
+   }
+   if (fd == _waitFd) _waitReady = true;
+   map<int, FdHandler>::iterator it = _fds.find(fd);
+   if (it == _fds.end()) return;
+   FdHandler h = it->second;            // it may remove itself
+   h(events);
+}
+
+void
+EventLoop::runPosted()
+{
+   vector<Handler> posted;
+   {
+      lock_guard<mutex> lock(_mutex);
+      posted.swap(_posted);
+   }
+   for (size_t i = 0, n = posted.size(); i < n; ++i)
+      posted[i]();
+}
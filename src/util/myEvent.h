@@ -0,0 +1,93 @@
+/****************************************************************************
+  FileName     [ myEvent.h ]
+  PackageName  [ util ]
+  Synopsis     [ Define class EventLoop, an epoll-based event loop ]
+  Author       [ Chung-Yang (Ric) Huang ]
+  Copyright    [ Copyleft(c) 2007-present LaDs(III), GIEE, NTU, Taiwan ]
+****************************************************************************/
+#ifndef MY_EVENT_H
+#define MY_EVENT_H
+
+#include <map>
+#include <set>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <functional>
+
+using namespace std;
+
+//----------------------------------------------------------------------
+//    Class : EventLoop
+//----------------------------------------------------------------------
+// Multiplexes, on the thread that runs it, the readiness of fds, timers
+// (timerfd), signals (signalfd) and handlers posted from other threads
+// (eventfd), so that they are served while the thread waits for input.
+// The terminal is read by a handler on myEventLoop() (see cmdCharDef.cpp)
+// and the command reader waits for it there, so whatever else is added
+// to it runs while the prompt is idle.
+//
+// Handlers run on the loop thread, one at a time; they may add or remove
+// watches, including their own. Only post() may be called from other
+// threads.
+//
+class EventLoop
+{
+public:
+   typedef function<void(unsigned events)>  FdHandler;  // EPOLLIN...
+   typedef function<void()>                 Handler;
+
+   EventLoop();
+   ~EventLoop();
+
+   bool isOpen() const { return _epfd >= 0; }
+   // Whether it is called on the thread that created the loop
+   bool isLoopThread() const { return this_thread::get_id() == _thread; }
+
+   // "fd" is watched for "events" until removed
+   bool addFd(int fd, unsigned events, const FdHandler& h);
+   bool removeFd(int fd);
+
+   // Return the id of the timer, or -1 on failure
+   int addTimer(unsigned ms, const Handler& h, bool periodic = false);
+   bool removeTimer(int id);
+
+   // "sig" is blocked in the calling thread (and the threads it creates
+   // afterwards) and delivered to "h" instead; add signals before the
+   // worker threads are started
+   bool addSignal(int sig, const Handler& h);
+
+   // Run "h" on the loop thread at its next wait; thread-safe
+   void post(const Handler& h);
+
+   // Serve events until "fd" has any of "events" (if "fd" >= 0), or for
+   // up to "ms" (-1: no limit). Return 1 if "fd" is ready (or cannot be
+   // watched), 0 on timeout and -1 if interrupted by a signal not added.
+   int waitFd(int fd, unsigned events, int ms = -1);
+   // Serve the events ready within "ms"; return their number, or -1
+   int runOnce(int ms);
+
+private:
+   EventLoop(const EventLoop&);
+   EventLoop& operator = (const EventLoop&);
+
+   void dispatch(int fd, unsigned events);
+   void runPosted();
+
+   thread::id                 _thread;
+   int                        _epfd;
+   int                        _postFd;       // eventfd of post()
+   map<int, FdHandler>        _fds;
+   set<int>                   _timers;       // their timerfds
+   map<int, int>              _signalFds;    // of each signal
+   int                        _waitFd;       // of waitFd(); -1 if none
+   bool                       _waitReady;
+   mutex                      _mutex;        // guards _posted
+   vector<Handler>            _posted;
+};
+
+// The loop of the main thread, created on first use; main() makes sure
+// that is on the main thread
+extern EventLoop& myEventLoop();
+
+#endif // MY_EVENT_H
@@ -0,0 +1,339 @@
+/****************************************************************************
+  FileName     [ myShm.cpp ]
+  PackageName  [ util ]
+  Synopsis     [ Define member functions for class ShmChannel ]
+  Author       [ Chung-Yang (Ric) Huang ]
+  Copyright    [ Copyleft(c) 2007-present LaDs(III), GIEE, NTU, Taiwan ]
+****************************************************************************/
+#include <cstring>
+#include <climits>
+#include <chrono>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "myShm.h"
+
+using namespace std;
+
+//----------------------------------------------------------------------
+//    Global static funcitons
+//----------------------------------------------------------------------
+#define SHM_MAGIC        0x434d4453  // "SDMC"
+#define SHM_HEADER_SIZE  4096
+#define SHM_SPIN         (1 << 12)   // polls of an empty or full ring
+#define SHM_SLEEP_MS     20          // before checking the peer again
+
+// Not FUTEX_PRIVATE_FLAG; the word is shared between processes
+static void
+futexWait(atomic<uint32_t>& word, uint32_t old, unsigned ms)
+{
+   struct timespec ts = { time_t(ms / 1000), long(ms % 1000) * 1000000 };
+   syscall(SYS_futex, (uint32_t*)&word, FUTEX_WAIT, old, &ts, 0, 0);
+}
+
+static void
+futexWake(atomic<uint32_t>& word)
+{
+   syscall(SYS_futex, (uint32_t*)&word, FUTEX_WAKE, INT_MAX, 0, 0, 0);
+}
+
+// With F_OFD_SETLK, lock byte "b" of "fd"; with F_OFD_GETLK, check if
+// it is locked through another open file. The locks are owned by the open
+// file, so that closing another descriptor of it does not release them.
+// Return false if it cannot be locked, or is not locked by another.
+static bool
+lockByte(int fd, int cmd, int b)
+{
+   struct flock fl;
+   memset(&fl, 0, sizeof(fl));
+   fl.l_type = F_WRLCK;
+   fl.l_whence = SEEK_SET;
+   fl.l_start = b;
+   fl.l_len = 1;
+   if (fcntl(fd, cmd, &fl) != 0) return false;
+   return cmd == F_OFD_SETLK || fl.l_type != F_UNLCK;
+}
+
+// Spinning only takes the CPU from the peer if there is just one
+static unsigned
+spinCount()
+{
+   static const unsigned n =
+      (thread::hardware_concurrency() > 1)? SHM_SPIN: 0;
+   return n;
+}
+
+static inline void
+cpuRelax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+   __builtin_ia32_pause();
+#endif
+}
+
+
+//----------------------------------------------------------------------
+//    Member Function for class ShmChannel
+//----------------------------------------------------------------------
+// Create "file" with rings of "ringSize" bytes, a power of 2, and map it.
+// Return false if it cannot be created.
+bool
+ShmChannel::create(const string& file, uint32_t ringSize)
+{
+   close();
+   if (ringSize < 64 || ringSize > (1u << 30) || (ringSize & (ringSize - 1)))
+      return false;
+   int fd = ::open(file.c_str(), O_RDWR | O_CREAT, 0600);
+   if (fd < 0) return false;
+   // Another server may still be using the file
+   if (!lockByte(fd, F_OFD_SETLK, 0)) {
+      ::close(fd);
+      return false;
+   }
+   size_t size = SHM_HEADER_SIZE + 2 * size_t(ringSize);
+   void* p = MAP_FAILED;
+   if (ftruncate(fd, 0) == 0 && ftruncate(fd, size) == 0)
+      p = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+   if (p == MAP_FAILED) {
+      ::close(fd);
+      unlink(file.c_str());
+      return false;
+   }
+
+   // The file is all zeros, so the atomics start at 0
+   _hdr = (ShmHeader*)p;
+   _mapSize = size;
+   _fd = fd;
+   _side = 0;
+   _file = file;
+   _hdr->_version = SHM_VERSION;
+   _hdr->_ringSize = ringSize;
+   _hdr->_ring[0]._offset = SHM_HEADER_SIZE;
+   _hdr->_ring[1]._offset = SHM_HEADER_SIZE + ringSize;
+   _hdr->_pid[0].store(getpid());
+   _hdr->_magic.store(SHM_MAGIC, memory_order_release);
+   return true;
+}
+
+// Attach to the channel created in "file", waiting up to "waitMs" for
+// the server to create it.
+// Return false if there is no such channel or it has a client already.
+bool
+ShmChannel::attach(const string& file, unsigned waitMs)
+{
+   close();
+   chrono::steady_clock::time_point end =
+      chrono::steady_clock::now() + chrono::milliseconds(waitMs);
+   int fd = -1;
+   ShmHeader* hdr = 0;
+   while (true) {
+      if (fd < 0) fd = ::open(file.c_str(), O_RDWR);
+      struct stat st;
+      if (fd >= 0 && fstat(fd, &st) == 0 && st.st_size >= SHM_HEADER_SIZE) {
+         void* p = mmap(0, SHM_HEADER_SIZE, PROT_READ | PROT_WRITE,
+                        MAP_SHARED, fd, 0);
+         if (p != MAP_FAILED) {
+            hdr = (ShmHeader*)p;
+            if (hdr->_magic.load(memory_order_acquire) == SHM_MAGIC) break;
+            munmap(p, SHM_HEADER_SIZE);
+            hdr = 0;
+         }
+      }
+      if (chrono::steady_clock::now() >= end) {
+         if (fd >= 0) ::close(fd);
+         return false;
+      }
+      this_thread::sleep_for(chrono::milliseconds(1));
+   }
+
+   size_t size = SHM_HEADER_SIZE + 2 * size_t(hdr->_ringSize);
+   bool ok = (hdr->_version == SHM_VERSION) && lockByte(fd, F_OFD_SETLK, 1);
+   munmap(hdr, SHM_HEADER_SIZE);
+   void* p = ok? mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0):
+                 MAP_FAILED;
+   if (p == MAP_FAILED) {
+      ::close(fd);
+      return false;
+   }
+
+   _hdr = (ShmHeader*)p;
+   _mapSize = size;
+   _fd = fd;
+   _side = 1;
+   _file = file;
+   _hdr->_pid[1].store(getpid());
+   // A server killed before closing leaves the file behind
+   if (peerGone()) {
+      munmap(_hdr, _mapSize);
+      ::close(_fd);
+      _hdr = 0;
+      return false;
+   }
+   return true;
+}
+
+// Tell the peer this side is gone and unmap the channel; the server
+// removes the file.
+void
+ShmChannel::close()
+{
+   if (!_hdr) return;
+   _hdr->_closed[_side].store(1);
+   for (int i = 0; i < 2; ++i) {
+      futexWake(_hdr->_ring[i]._tail);
+      futexWake(_hdr->_ring[i]._head);
+   }
+   if (_side == 0) unlink(_file.c_str());
+   munmap(_hdr, _mapSize);
+   ::close(_fd);                     // releases the lock
+   _hdr = 0;
+}
+
+// Return false at the end of the requests, i.e. the client is gone
+bool
+ShmChannel::getRequest(string& line)
+{
+   uint32_t len;
+   if (!recv(&len, sizeof(len))) return false;
+   line.resize(len);
+   return recv(&line[0], len);
+}
+
+bool
+ShmChannel::putReply(const ShmReply& reply)
+{
+   uint32_t head[4] = { uint32_t(reply._status), reply._us,
+                        uint32_t(reply._out.size()),
+                        uint32_t(reply._err.size()) };
+   _buf.assign((const char*)head, sizeof(head));
+   _buf += reply._out;
+   _buf += reply._err;
+   return send(_buf.data(), _buf.size());
+}
+
+bool
+ShmChannel::post(const string& line)
+{
+   uint32_t len = line.size();
+   _buf.assign((const char*)&len, sizeof(len));
+   _buf += line;
+   return send(_buf.data(), _buf.size());
+}
+
+// Return false if the server is gone before replying
+bool
+ShmChannel::wait(ShmReply& reply)
+{
+   uint32_t head[4];
+   if (!recv(head, sizeof(head))) return false;
+   reply._status = int(head[0]);
+   reply._us = head[1];
+   reply._out.resize(head[2]);
+   reply._err.resize(head[3]);
+   return recv(&reply._out[0], head[2]) && recv(&reply._err[0], head[3]);
+}
+
+// Append "n" bytes to the ring this side writes; the reader sees each
+// part as soon as it is copied in.
+bool
+ShmChannel::send(const void* p, size_t n)
+{
+   if (!_hdr) return false;
+   ShmRing& r = _hdr->_ring[1 - _side];
+   const uint32_t size = _hdr->_ringSize;
+   char* buf = data(r);
+   const char* src = (const char*)p;
+   uint32_t tail = r._tail.load(memory_order_relaxed);
+   while (n > 0) {
+      uint32_t head = r._head.load(memory_order_acquire);
+      uint32_t room = size - (tail - head);
+      if (room == 0) {
+         if (!waitChange(r._head, head, r._headWaiter)) return false;
+         continue;
+      }
+      uint32_t k = min(size_t(room), n);
+      uint32_t pos = tail & (size - 1), first = min(k, size - pos);
+      memcpy(buf + pos, src, first);
+      memcpy(buf, src + first, k - first);
+      tail += k;
+      r._tail.store(tail, memory_order_release);
+      atomic_thread_fence(memory_order_seq_cst);
+      if (r._tailWaiter.load(memory_order_relaxed)) {
+         r._tailWaiter.store(0, memory_order_relaxed);
+         futexWake(r._tail);
+      }
+      src += k;
+      n -= k;
+   }
+   return true;
+}
+
+// Take "n" bytes from the ring this side reads
+bool
+ShmChannel::recv(void* p, size_t n)
+{
+   if (!_hdr) return false;
+   ShmRing& r = _hdr->_ring[_side];
+   const uint32_t size = _hdr->_ringSize;
+   const char* buf = data(r);
+   char* dst = (char*)p;
+   uint32_t head = r._head.load(memory_order_relaxed);
+   while (n > 0) {
+      uint32_t tail = r._tail.load(memory_order_acquire);
+      uint32_t avail = tail - head;
+      if (avail == 0) {
+         if (!waitChange(r._tail, tail, r._tailWaiter)) return false;
+         continue;
+      }
+      uint32_t k = min(size_t(avail), n);
+      uint32_t pos = head & (size - 1), first = min(k, size - pos);
+      memcpy(dst, buf + pos, first);
+      memcpy(dst + first, buf, k - first);
+      head += k;
+      r._head.store(head, memory_order_release);
+      atomic_thread_fence(memory_order_seq_cst);
+      if (r._headWaiter.load(memory_order_relaxed)) {
+         r._headWaiter.store(0, memory_order_relaxed);
+         futexWake(r._head);
+      }
+      dst += k;
+      n -= k;
+   }
+   return true;
+}
+
+// Spin, then sleep, until "word" is no longer "old", "waiter" telling
+// the peer to wake us up.
+// Return false if the peer is gone instead.
+bool
+ShmChannel::waitChange(atomic<uint32_t>& word, uint32_t old,
+                       atomic<uint32_t>& waiter)
+{
+   for (unsigned i = 0, n = spinCount(); i < n; ++i) {
+      if (word.load(memory_order_acquire) != old) return true;
+      cpuRelax();
+   }
+   while (true) {
+      waiter.store(1, memory_order_relaxed);
+      atomic_thread_fence(memory_order_seq_cst);
+      if (word.load(memory_order_acquire) != old) return true;
+      futexWait(word, old, SHM_SLEEP_MS);
+      if (word.load(memory_order_acquire) != old) return true;
+      if (peerGone()) return false;
+   }
+}
+
+// Each side holds a lock on byte _side of the file, which goes away with
+// the process even before it is reaped
+bool
+ShmChannel::peerGone() const
+{
+   int peer = 1 - _side;
+   if (_hdr->_closed[peer].load()) return true;
+   if (_hdr->_pid[peer].load() == 0) return false;  // not attached yet
+   return !lockByte(_fd, F_OFD_GETLK, peer);
+}
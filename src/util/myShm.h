@@ -0,0 +1,113 @@
+/****************************************************************************
+  FileName     [ myShm.h ]
+  PackageName  [ util ]
+  Synopsis     [ Define class ShmChannel, a shared-memory command channel ]
+  Author       [ Chung-Yang (Ric) Huang ]
+  Copyright    [ Copyleft(c) 2007-present LaDs(III), GIEE, NTU, Taiwan ]
+****************************************************************************/
+#ifndef MY_SHM_H
+#define MY_SHM_H
+
+#include <string>
+#include <atomic>
+#include <cstdint>
+
+using namespace std;
+
+//----------------------------------------------------------------------
+//    Channel layout
+//----------------------------------------------------------------------
+// The server (myexe -Shm <file>) creates and maps <file>, preferably on
+// a tmpfs such as /dev/shm, and one client attaches to it. The file is
+// a header page followed by two single-producer single-consumer byte
+// rings: requests from the client and replies from the server.
+//
+//    request:  <uint32 len> <command line>
+//    reply:    <uint32 status> <uint32 us> <uint32 nOut> <uint32 nErr>
+//              <out> <err>
+//
+// "status" is the CmdExecStatus of the line and "us" its execution time;
+// <out> and <err> are what it printed to cout and cerr.
+//
+// A reader spins for a while on an empty ring, then sleeps on a futex
+// until the writer publishes more; a writer on a full ring does the same.
+// A writer only makes the futex call when the reader is asleep, so a
+// busy channel needs no system call at all.
+//
+#define SHM_VERSION     1
+#define SHM_RING_SIZE   (1 << 20)    // bytes in each ring; a power of 2
+
+struct ShmRing
+{
+   atomic<uint32_t>  _tail;          // bytes written; the reader waits on it
+   atomic<uint32_t>  _tailWaiter;    // the reader sleeps on _tail
+   char              _pad0[56];
+   atomic<uint32_t>  _head;          // bytes read; the writer waits on it
+   atomic<uint32_t>  _headWaiter;    // the writer sleeps on _head
+   char              _pad1[56];
+   uint32_t          _offset;        // of the data from the mapping
+};
+
+struct ShmHeader
+{
+   atomic<uint32_t>  _magic;         // set once the rest is initialized
+   uint32_t          _version;
+   uint32_t          _ringSize;
+   atomic<int32_t>   _pid[2];        // of the server and the attached client
+   atomic<uint32_t>  _closed[2];     // the server or the client is gone
+   ShmRing           _ring[2];       // requests and replies
+};
+
+struct ShmReply
+{
+   int      _status;                 // a CmdExecStatus
+   unsigned _us;
+   string   _out;
+   string   _err;
+};
+
+//----------------------------------------------------------------------
+//    Class : ShmChannel
+//----------------------------------------------------------------------
+// The client side posts requests and waits for their replies, which come
+// in the order of the requests; a client may post several requests before
+// waiting, as long as they and their replies fit in the rings.
+//
+class ShmChannel
+{
+public:
+   ShmChannel() : _hdr(0), _mapSize(0), _fd(-1), _side(0) {}
+   ~ShmChannel() { close(); }
+
+   // Server side
+   bool create(const string& file, uint32_t ringSize = SHM_RING_SIZE);
+   bool getRequest(string& line);
+   bool putReply(const ShmReply& reply);
+
+   // Client side; attach() waits up to "waitMs" for the server
+   bool attach(const string& file, unsigned waitMs = 5000);
+   bool post(const string& line);
+   bool wait(ShmReply& reply);
+   bool exec(const string& line, ShmReply& reply) {
+      return post(line) && wait(reply); }
+
+   void close();
+   bool isOpen() const { return _hdr != 0; }
+
+private:
+   bool send(const void* p, size_t n);
+   bool recv(void* p, size_t n);
+   bool waitChange(atomic<uint32_t>& word, uint32_t old,
+                   atomic<uint32_t>& waiter);
+   bool peerGone() const;
+   char* data(const ShmRing& r) const { return (char*)_hdr + r._offset; }
+
+   ShmHeader*  _hdr;
+   size_t      _mapSize;
+   int         _fd;                  // of the file, holding our lock
+   int         _side;                // 0 for the server, 1 for the client
+   string      _file;
+   string      _buf;
+};
+
+#endif // MY_SHM_H
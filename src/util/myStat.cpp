@@ -0,0 +1,73 @@
+/****************************************************************************
+  FileName     [ myStat.cpp ]
+  PackageName  [ util ]
+  Synopsis     [ Runtime counters of the hot paths ]
+  Author       [ Chung-Yang (Ric) Huang ]
+  Copyright    [ Copyleft(c) 2007-present LaDs(III), GIEE, NTU, Taiwan ]
+****************************************************************************/
+#include <streambuf>
+#include "myStat.h"
+
+using namespace std;
+
+//----------------------------------------------------------------------
+//    Global variables
+//----------------------------------------------------------------------
+atomic<size_t> statCounters[STAT_TOT];
+
+//----------------------------------------------------------------------
+//    Global static variables and funcitons
+//----------------------------------------------------------------------
+static const char* statNames[STAT_TOT] = {
+   "Chars read", "Lines parsed", "Cmd lookups", "Cmds scanned",
+   "listDir calls", "listDir entries", "Dofile opens", "Dofile max depth",
+   "Output bytes", "Dofile cache hits", "Dofile prefetched"
+};
+
+// Passes everything on to "_buf", counting the bytes
+class StatOutBuf: public streambuf
+{
+public:
+   StatOutBuf(streambuf* buf) : _buf(buf) {}
+
+protected:
+   int overflow(int ch) {
+      if (ch == traits_type::eof()) return traits_type::not_eof(ch);
+      statAdd(STAT_OUTPUT_BYTES);
+      return _buf->sputc(traits_type::to_char_type(ch));
+   }
+   streamsize xsputn(const char* s, streamsize n) {
+      streamsize m = _buf->sputn(s, n);
+      statAdd(STAT_OUTPUT_BYTES, m);
+      return m;
+   }
+   int sync() { return _buf->pubsync(); }
+
+private:
+   streambuf*  _buf;
+};
+
+
+//----------------------------------------------------------------------
+//    Global functions
+//----------------------------------------------------------------------
+const char*
+statName(StatCounter c)
+{
+   return statNames[c];
+}
+
+void
+resetStats()
+{
+   for (int i = 0; i < STAT_TOT; ++i)
+      statCounters[i].store(0, memory_order_relaxed);
+}
+
+// Count the bytes written to "os" from now on (STAT_OUTPUT_BYTES). The
+// counting buffer lives until exit.
+void
+countOutput(ostream& os)
+{
+   os.rdbuf(new StatOutBuf(os.rdbuf()));
+}
@@ -0,0 +1,62 @@
+/****************************************************************************
+  FileName     [ myStat.h ]
+  PackageName  [ util ]
+  Synopsis     [ Define the runtime counters of the hot paths ]
+  Author       [ Chung-Yang (Ric) Huang ]
+  Copyright    [ Copyleft(c) 2007-present LaDs(III), GIEE, NTU, Taiwan ]
+****************************************************************************/
+#ifndef MY_STAT_H
+#define MY_STAT_H
+
+#include <ostream>
+#include <atomic>
+
+using namespace std;
+
+// The counters are relaxed atomics; they are only read for reporting.
+enum StatCounter
+{
+   STAT_CHARS_READ        = 0,  // characters read by the command reader
+   STAT_LINES_PARSED      = 1,  // command lines parsed
+   STAT_CMD_LOOKUPS       = 2,  // command lookups in CmdParser
+   STAT_CMD_SCANNED       = 3,  // commands compared by the lookups
+   STAT_LISTDIR_CALLS     = 4,  // listDir() calls
+   STAT_LISTDIR_ENTRIES   = 5,  // entries returned by listDir()
+   STAT_DOFILE_OPENS      = 6,  // dofiles opened
+   STAT_DOFILE_MAX_DEPTH  = 7,  // maximum dofile nesting depth
+   STAT_OUTPUT_BYTES      = 8,  // bytes written to a counted stream
+   STAT_DOFILE_CACHE_HITS = 9,  // dofiles opened from the content cache
+   STAT_DOFILE_PREFETCHED = 10, // dofiles opened from a prefetched text
+
+   // dummy
+   STAT_TOT
+};
+
+extern atomic<size_t> statCounters[STAT_TOT];
+
+inline void
+statAdd(StatCounter c, size_t n = 1)
+{
+   statCounters[c].fetch_add(n, memory_order_relaxed);
+}
+
+inline void
+statMax(StatCounter c, size_t n)
+{
+   size_t cur = statCounters[c].load(memory_order_relaxed);
+   while (n > cur &&
+          !statCounters[c].compare_exchange_weak(cur, n, memory_order_relaxed));
+}
+
+inline size_t
+statGet(StatCounter c)
+{
+   return statCounters[c].load(memory_order_relaxed);
+}
+
+// In myStat.cpp
+extern const char* statName(StatCounter c);
+extern void resetStats();
+extern void countOutput(ostream& os);
+
+#endif // MY_STAT_H
@@ -14,6 +14,7 @@
 #include <iostream>
 #include <iomanip>
 #include <algorithm>
+#include "myStat.h"
 
 using namespace std;
 
@@ -30,6 +31,8 @@ int listDir
       return errno;
    }
 
+   statAdd(STAT_LISTDIR_CALLS);
+   size_t nFiles = files.size();
    const char *pp = prefix.size()? prefix.c_str(): 0;
    while ((dirp = readdir(dp)) != NULL) {
       if (string(dirp->d_name) == "." ||
@@ -39,5 +42,6 @@ int listDir
    }
    sort(files.begin(), files.end());
    closedir(dp);
+   statAdd(STAT_LISTDIR_ENTRIES, files.size() - nFiles);
    return 0;
 }